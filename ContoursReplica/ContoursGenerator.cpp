@@ -1,14 +1,16 @@
 #include "ContoursGenerator.h"
 #include "DrawOperations.h"
+#include "ImageKernels.h"
 #include <opencv2/opencv.hpp>
-#include <opencv2/ximgproc.hpp>
 #include <qpainter.h>
 #include <qfile.h>
 #include <qfiledialog.h>
 #include <QProgressDialog>
+#include <QDebug>
 #include "RandomGenerator.h"
 #include <quuid.h>
 #include <filesystem>
+#include <fstream>
 #include <windows.h>
 #include "Strings.h"
 #include "qtextstream.h"
@@ -19,6 +21,8 @@ ContoursGenerator::ContoursGenerator(QWidget* parent)
 {
 	ui->setupUi(this);
 
+	qInfo().noquote() << "Image kernels:" << QString::fromStdString(ImageKernels::description());
+
 	initConnections();
 
 	OnChangeMode();
@@ -42,6 +46,10 @@ GenerationParams ContoursGenerator::getUIParams()
 		int minMul = ui->spinBox_TotalMulMin->value();
 		int maxMul = ui->spinBox_TotalMulMax->value();
 		params.mul = RandomGenerator::instance().getRandomInt(minMul, maxMul);
+		params.noise = getNoiseBackend();
+		params.noiseTolerance = ui->doubleSpinBox_NoiseTolerance->value();
+		params.analyticGradient = ui->checkBox_AnalyticGradient->isChecked();
+		params.marchingSquares = ui->checkBox_MarchingSquares->isChecked();
 
 		params.generateWells = ui->groupBox_Wells->isChecked();
 		params.numOfWells = ui->spinBox_Wells->value();
@@ -60,12 +68,18 @@ GenerationParams ContoursGenerator::getUIParams()
 		params.drawValues = ui->groupBox_DrawValues->isChecked();
 		params.saveValuesToFile = ui->checkBox_saveValuesToFile->isChecked();
 		params.saveBoundingBoxesToFile = ui->checkBox_SaveBB->isChecked();
+		params.saveContoursToFile = ui->checkBox_SaveContours->isChecked();
 		params.textDistance = ui->spinBox_TextDistance->value();
 
 		int minTextSize = ui->spinBox_TextMinSize->value();
 		int maxTextSize = ui->spinBox_TextMaxSize->value();
 		params.textSize = RandomGenerator::instance().getRandomInt(minTextSize, maxTextSize);
 
+		params.fractal.octaves = ui->spinBox_Octaves->value();
+		params.fractal.persistence = static_cast<float>(ui->doubleSpinBox_Persistence->value());
+		params.fractal.lacunarity = static_cast<float>(ui->doubleSpinBox_Lacunarity->value());
+		params.fractal.scale = static_cast<float>(ui->doubleSpinBox_Scale->value());
+
 		params.mode = getGenMode();
 	}
 	return params;
@@ -96,6 +110,7 @@ void ContoursGenerator::OnGenerateImage()
 	m_generatedImage = genImg.image;
 	m_generatedMask = genImg.mask;
 	m_bboxes = genImg.bboxes;
+	m_contours = std::move(genImg.contours);
 
 	OnUpdateImage();
 }
@@ -104,11 +119,11 @@ void ContoursGenerator::OnUpdateImage()
 {
 	if (ui->checkBox_ShowMask->isChecked())
 	{
-		ui->label_Image->setPixmap(m_generatedMask);
+		ui->label_Image->setPixmap(QPixmap::fromImage(m_generatedMask));
 	}
 	else
 	{
-		ui->label_Image->setPixmap(m_generatedImage);
+		ui->label_Image->setPixmap(QPixmap::fromImage(m_generatedImage));
 	}
 }
 
@@ -125,7 +140,7 @@ void ContoursGenerator::OnSaveImage()
 		return;
 	}
 
-	saveImage(folderName, m_generatedImage, m_generatedMask, m_bboxes);
+	saveImage(folderName, m_generatedImage, m_generatedMask, m_bboxes, m_contours);
 }
 
 void saveBoundingBoxesToFile(const std::vector<BoundingBox>& bbs, const QString& filePath)
@@ -154,24 +169,53 @@ void saveBoundingBoxesToFile(const std::vector<BoundingBox>& bbs, const QString&
 	}
 }
 
-void ContoursGenerator::saveImage(const QString& folderPath, const QPixmap& img, const QPixmap& mask, const std::vector<BoundingBox>& bboxes)
+// One contour per line: value, closed, then start x, start y and the Freeman directions (0 = up, clockwise)
+// of every run of 8-connected points
+void saveContoursToFile(const ChainCodeSet& codes, const QString& filePath)
+{
+	QFile file(filePath);
+	if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		QTextStream out(&file);
+
+		std::string steps;
+		for (size_t i = 0; i < codes.size(); ++i) {
+			out << codes.value[i] << "," << int(codes.isClosed[i]);
+			for (size_t r = codes.runOffsets[i]; r < codes.runOffsets[i + 1]; ++r) {
+				steps.resize(codes.runCount[r] - 1);
+				for (size_t k = 0; k < steps.size(); ++k) {
+					steps[k] = static_cast<char>('0' + static_cast<int>(codes.step(r, k)));
+				}
+				out << ";" << codes.start[r].x << "," << codes.start[r].y << "," << steps.c_str();
+			}
+
+			out << "\n";
+		}
+
+		file.close();
+	}
+}
+
+void ContoursGenerator::saveImage(const QString& folderPath, const QImage& img, const QImage& mask, const std::vector<BoundingBox>& bboxes, const ChainCodeSet& contours)
 {
 	QDir().mkpath(folderPath + "/images");
 	QDir().mkpath(folderPath + "/masks");
 	if (!bboxes.empty())
 		QDir().mkpath(folderPath + "/bboxes");
+	if (!contours.empty())
+		QDir().mkpath(folderPath + "/contours");
 
 	QString baseName;
 	int index = 1;
-	QString imageFileName, maskFileName, bboxFileName;
+	QString imageFileName, maskFileName, bboxFileName, contoursFileName;
 	do
 	{
 		baseName = QString::number(index);
 		imageFileName = folderPath + "/images/" + baseName + ".jpg";
 		maskFileName = folderPath + "/masks/" + baseName + ".jpg";
 		bboxFileName = folderPath + "/bboxes/" + baseName + ".txt";
+		contoursFileName = folderPath + "/contours/" + baseName + ".txt";
 		index++;
-	} while (QFile::exists(imageFileName) || QFile::exists(maskFileName) || QFile::exists(bboxFileName));
+	} while (QFile::exists(imageFileName) || QFile::exists(maskFileName) || QFile::exists(bboxFileName) || QFile::exists(contoursFileName));
 
 	if (!img.save(imageFileName, "JPG"))
 	{
@@ -184,24 +228,53 @@ void ContoursGenerator::saveImage(const QString& folderPath, const QPixmap& img,
 	}
 	if (!bboxes.empty())
 		saveBoundingBoxesToFile(bboxes, bboxFileName);
+	if (!contours.empty())
+		saveContoursToFile(contours, contoursFileName);
+}
+
+// Chain codes of the contours of codes that touch rect, in the coordinates of rect
+static ChainCodeSet contoursInRect(const ChainCodeSet& codes, const ContourIndex& index, const cv::Rect& rect)
+{
+	std::vector<int> ids;
+	index.query(rect, ids);
+	std::sort(ids.begin(), ids.end());
+
+	ChainCodeSet result;
+	std::vector<cv::Point> points;
+	for (int i : ids) {
+		points.clear();
+		for (const cv::Point& pt : codes[i]) {
+			points.push_back(pt - rect.tl());
+		}
+		result.add({ points.data(), points.size() }, codes.value[i], codes.isClosed[i] != 0);
+	}
+	return result;
 }
 
 void ContoursGenerator::saveImageSplit(const QString& folderPath, const GenImg& gen)
 {
+	// the map is generated whole and sliced, so thinning, depth, fill colours and wells are per map
 	int baseSize = 256;
-	int width = gen.image.width();
-	int height = gen.image.height();
-	int numX = width / baseSize;
-	int numY = height / baseSize;
+	int numX = gen.image.width() / baseSize;
+	int numY = gen.image.height() / baseSize;
+	const ContourIndex index(gen.contours.boundingRect);
 
 	for (int i = 0; i < numX; ++i)
 	{
 		for (int j = 0; j < numY; ++j)
 		{
 			QRect rect(i * baseSize, j * baseSize, baseSize, baseSize);
-			QPixmap img = gen.image.copy(rect);
-			QPixmap mask = gen.mask.copy(rect);
-			saveImage(folderPath, img, mask, gen.bboxes);
+
+			// bounding boxes and contours of the tile, in its coordinates
+			std::vector<BoundingBox> bboxes;
+			for (const BoundingBox& bb : gen.bboxes) {
+				if (bb.bbox.intersects(rect)) {
+					bboxes.emplace_back(bb.bbox.translated(-rect.topLeft()), bb.value);
+				}
+			}
+			const ChainCodeSet contours = contoursInRect(gen.contours, index, cv::Rect(rect.x(), rect.y(), rect.width(), rect.height()));
+
+			saveImage(folderPath, gen.image.copy(rect), gen.mask.copy(rect), bboxes, contours);
 		}
 	}
 }
@@ -216,6 +289,16 @@ GenerationMode ContoursGenerator::getGenMode()
 	return GenerationMode::legacy;
 }
 
+NoiseBackend ContoursGenerator::getNoiseBackend()
+{
+	if (ui) {
+		if (ui->checkBox_OpenSimplex->isChecked()) {
+			return NoiseBackend::openSimplex2S;
+		}
+	}
+	return NoiseBackend::perlin;
+}
+
 FillMode ContoursGenerator::getFillMode()
 {
 	if (ui) {
@@ -263,6 +346,7 @@ void ContoursGenerator::OnChangeMode()
 		ui->label_width->setText(str_width);
 		ui->label_height->setText(str_height);
 		ui->groupBox_PerlinNoise->setVisible(false);
+		ui->groupBox_HeightField->setVisible(true);
 		ui->spinBox_MinDensity->setVisible(true);
 		ui->spinBox_MaxDensity->setVisible(true);
 		ui->label_MinDensity->setVisible(true);
@@ -274,6 +358,7 @@ void ContoursGenerator::OnChangeMode()
 		ui->label_width->setText(str_width_pixels);
 		ui->label_height->setText(str_height_pixels);
 		ui->groupBox_PerlinNoise->setVisible(true);
+		ui->groupBox_HeightField->setVisible(false);
 		ui->spinBox_MinDensity->setVisible(false);
 		ui->spinBox_MaxDensity->setVisible(false);
 		ui->label_MinDensity->setVisible(false);
@@ -319,103 +404,121 @@ bool run_python_script_silently(const std::string& command)
 
 GenImg ContoursGenerator::generateImage()
 {
+	// widgets are read here, on the GUI thread; the generation itself may run on any thread
 	GenerationParams params = getUIParams();
+	WellParams wellParams = getUIWellParams();
 
 	if (params.mode == GenerationMode::python) {
-		return _generateImage_python();
+		return _generateImage_python(params, wellParams);
 	}
 	else {
-		return _generateImage_legacy();
+		if (params.noiseTolerance > 0 && !params.analyticGradient) {
+			const NoiseSampling sampling = ContoursOperations::noiseSampling(params);
+			qInfo().noquote() << "Noise sampling: step" << sampling.step << "px, error <=" << sampling.errorBound << "levels";
+		}
+
+		TileParams tile;
+		tile.seed = RandomGenerator::instance().getRandomInt(INT_MAX);
+		return _generateImage_legacy(params, tile, wellParams);
 	}
 }
 
-GenImg ContoursGenerator::_generateImage_legacy()
+GenImg ContoursGenerator::_generateImage_legacy(const GenerationParams& params, const TileParams& tile, const WellParams& wellParams)
 {
-	GenerationParams params = getUIParams();
-
 	cv::Mat isolines; // isolines mat
 	cv::Mat mask; // mask mat
-	QPixmap pixIso; // visual representation pixmap
-	QPixmap pixMask; // mask representation pixmap
+	SharedFrame frameIso; // visual representation, cropSize wider on each side than the drawing
+	SharedFrame imgIso; // the drawing, a view of frameIso
+	QImage imgMask(params.width, params.height, QImage::Format_RGB32); // mask representation image
+	imgMask.fill(Qt::black);
 	std::vector<BoundingBox> bboxes;
+	ChainCodeSet codes; // contours for the export, about 20 times smaller than the points
 
 	int cropSize = 1;
 
 	if (params.generateIsolines) {
-		isolines = ContoursOperations::generateIsolines(params);
+		cv::Mat gradient;
+		ContourSet contours;
+		cv::Mat labels; // contour index + 1 per pixel, 0 elsewhere
+		cv::Size frameSize;
+
+		if (params.marchingSquares) {
+			// subpixel contours straight from the noise field, no thinning or tracing
+			cv::Mat field = ContoursOperations::generateNoiseField(params, tile);
+
+			// crop by 1 pixel
+			cv::Rect cropRect(cropSize, cropSize, field.cols - 2 * cropSize, field.rows - 2 * cropSize);
+			ContoursOperations::marchingSquares(field(cropRect), contours, &labels);
+			frameSize = cropRect.size();
+		}
+		else {
+			isolines = ContoursOperations::generateIsolines(params, tile, &gradient);
 
-		mask = cv::Scalar(255) - isolines;
+			mask = cv::Scalar(255) - isolines;
 
-		// apply thinning
-		cv::Mat thinned;
-		cv::ximgproc::thinning(mask, thinned, cv::ximgproc::THINNING_GUOHALL);
+			// apply thinning
+			cv::Mat thinned;
+			ContoursOperations::thinning(mask, thinned);
 
-		// crop by 1 pixel
-		cv::Rect cropRect(cropSize, cropSize, thinned.cols - 2 * cropSize, thinned.rows - 2 * cropSize);
-		thinned = thinned(cropRect);
+			// crop by 1 pixel
+			cv::Rect cropRect(cropSize, cropSize, thinned.cols - 2 * cropSize, thinned.rows - 2 * cropSize);
+			thinned = thinned(cropRect);
+			if (!gradient.empty()) {
+				gradient = gradient(cropRect);
+			}
 
-		// Find contours
-		std::vector<Contour> contours;
-		ContoursOperations::findContours(thinned, contours);
+			// Find contours
+			ContoursOperations::findContoursParallel(thinned, contours, &labels);
+			frameSize = cropRect.size();
+		}
 
-		cv::Mat contours_mat = cv::Mat::zeros(thinned.size(), CV_8UC1);
-		for (size_t i = 0; i < contours.size(); i++) {
-			const Contour& c = contours[i];
-			cv::Scalar color = cv::Scalar(255, 255, 255);
-			for (size_t j = 0; j < c.points.size(); ++j) {
-				contours_mat.at<uchar>(c.points[j]) = c.value;
+		if (params.saveContoursToFile) {
+			ContoursOperations::encodeChainCodes(contours, codes);
+			// contours are traced in the cropped drawing, the image keeps the crop border
+			for (cv::Point& pt : codes.start) {
+				pt += cv::Point(cropSize, cropSize);
 			}
 		}
 
 		// Find depth
-		ContoursOperations::findDepth(contours_mat, contours);
+		RegionMap regions;
+		ContoursOperations::findDepth(labels, contours, params.fillContours ? &regions : nullptr);
 
-		// Depth mat
-		cv::Mat depthMat = cv::Mat::zeros(thinned.size(), CV_8UC1);
-		for (size_t i = 0; i < contours.size(); i++) {
-			const Contour& c = contours[i];
-			for (size_t j = 0; j < c.points.size(); ++j) {
-				depthMat.at<uchar>(c.points[j]) = c.depth + 1;
-			}
-		}
+		// OpenCV and QPainter render into the same RGB32 pixels, nothing is converted or copied between them
+		frameIso = SharedFrame(frameSize.width + 2 * cropSize, frameSize.height + 2 * cropSize);
+		imgIso = frameIso.roi(cv::Rect(cv::Point(cropSize, cropSize), frameSize));
 
 		// Draw contours
-		cv::Mat drawing = params.fillContours ? cv::Mat::zeros(thinned.size(), CV_8UC3) : cv::Mat(thinned.size(), CV_8UC3, cv::Scalar(255, 255, 255));
+		cv::Mat& drawing = imgIso.mat;
+		drawing.setTo(params.fillContours ? cv::Scalar(0, 0, 0, 255) : cv::Scalar(255, 255, 255, 255));
 		for (size_t i = 0; i < contours.size(); i++) {
-			for (size_t j = 0; j < contours[i].points.size(); ++j) {
-				cv::Scalar color = contours[i].isClosed ? cv::Scalar(75, 75, 75) : cv::Scalar(150, 100, 150);
-				drawing.at<cv::Vec3b>(contours[i].points[j]) = cv::Vec3b(color[0], color[1], color[2]);
+			const cv::Vec4b color = contours.isClosed[i] ? cv::Vec4b(75, 75, 75, 255) : cv::Vec4b(150, 100, 150, 255);
+			for (const cv::Point& pt : contours.contourPoints(i)) {
+				drawing.at<cv::Vec4b>(pt) = color;
 			}
 		}
 
 		if (params.fillContours) {
 			// Fill areas
-			ContoursOperations::fillContours(contours_mat, contours, drawing, params.fillMode);
+			ContoursOperations::fillContours(regions, contours, drawing, params.fillMode);
 		}
 
 		// Inpaint contours on drawing
-		cv::Mat maskInpaint = cv::Mat::zeros(thinned.size(), CV_8UC1);
-		for (size_t i = 0; i < contours.size(); i++) {
-			const Contour& c = contours[i];
-			for (size_t j = 0; j < c.points.size(); ++j) {
-				maskInpaint.at<uchar>(c.points[j]) = 255;
-			}
-		}
-
-		// Inpaint
-		cv::inpaint(drawing, maskInpaint, drawing, 3, cv::INPAINT_TELEA);
-
-		pixIso = utils::cvMat2Pixmap(drawing);
+		ContoursOperations::inpaintContours(drawing, labels);
 
 		// Draw contours
 		float thickness = params.contoursThickness;
 		QFont font;
 		font.setPointSize(params.textSize);
 		{
-			QPainter painter(&pixIso);
-			for (const auto& contour : contours) {
+			// labels are drawn into one QImage, so their crops are read straight from its memory
+			QPainter painter(&imgIso.image);
+			// placed labels of every contour, so labels of neighbouring contours do not overlap
+			LabelGrid labelGrid(imgIso.image.width(), imgIso.image.height());
+			for (size_t i = 0; i < contours.size(); i++) {
+				const Contour contour = contours[i];
 				if (params.drawValues) {
-					DrawOperations::drawContourValues(painter, contour, thickness, QColor(Qt::black), font, params.textDistance, params.saveValuesToFile, params.saveBoundingBoxesToFile, bboxes);
+					DrawOperations::drawContourValues(painter, contour, thickness, QColor(Qt::black), font, params.textDistance, labelGrid, params.saveValuesToFile, params.saveBoundingBoxesToFile, bboxes, &gradient);
 				}
 				else {
 					DrawOperations::drawContour(painter, contour, QColor(Qt::black), thickness);
@@ -424,50 +527,36 @@ GenImg ContoursGenerator::_generateImage_legacy()
 		}
 
 		// Draw mask
-		mask = cv::Mat::zeros(params.height, params.width, CV_8UC1);
-		pixMask = utils::cvMat2Pixmap(mask);
 		{
-			QPainter painter(&pixMask);
-			for (const auto& contour : contours) {
-				DrawOperations::drawContour(painter, contour, QColor(Qt::white), thickness);
+			QPainter painter(&imgMask);
+			for (size_t i = 0; i < contours.size(); i++) {
+				DrawOperations::drawContour(painter, contours[i], QColor(Qt::white), thickness);
 			}
 		}
 	}
 	else {
-		mask = cv::Mat::zeros(params.height, params.width, CV_8UC1);
-		isolines = mask.clone() + cv::Scalar(255);
-		pixIso = utils::cvMat2Pixmap(isolines);
-		pixMask = utils::cvMat2Pixmap(mask);
+		frameIso = SharedFrame(params.width + 2 * cropSize, params.height + 2 * cropSize);
+		frameIso.image.fill(Qt::white);
+		imgIso = frameIso.roi(cv::Rect(cropSize, cropSize, params.width, params.height));
 	}
 
 	if (params.generateWells) {
-		WellParams wellParams = getUIWellParams();
 		for (int i = 0; i < params.numOfWells; ++i) {
-			DrawOperations::drawRandomWell(pixIso, wellParams);
+			DrawOperations::drawRandomWell(imgIso.image, wellParams);
 		}
 	}
 
-	// inpaint cropped pixels
-	cv::Mat pixIsoUncropped = utils::QPixmap2cvMat(pixIso, false);
-	cv::Mat maskUncropped = cv::Mat::zeros(pixIsoUncropped.size(), CV_8UC1);
-	// enlarge by 1 pixel
-	cv::copyMakeBorder(pixIsoUncropped, pixIsoUncropped, cropSize, cropSize, cropSize, cropSize, cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
-	cv::copyMakeBorder(maskUncropped, maskUncropped, cropSize, cropSize, cropSize, cropSize, cv::BORDER_CONSTANT, cv::Scalar(255));
-	cv::inpaint(pixIsoUncropped, maskUncropped, pixIsoUncropped, 3, cv::INPAINT_TELEA);
-
-	QPixmap pixIsoResult = utils::cvMat2Pixmap(pixIsoUncropped);
+	// restore the cropped pixels: replicate the border of the drawing into the frame around it
+	utils::replicateBorder(frameIso.mat, cropSize);
 
-	GenImg result{ pixIsoResult, pixMask, bboxes };
+	GenImg result{ std::move(frameIso.image), imgMask, bboxes, std::move(codes) };
 	return result;
 }
 
-GenImg ContoursGenerator::_generateImage_python()
+GenImg ContoursGenerator::_generateImage_python(const GenerationParams& params, const WellParams& wellParams)
 {
-	GenerationParams params = getUIParams();
-
 	cv::Mat isolines; // isolines mat
 	cv::Mat mask; // mask mat
-	QPixmap pixIso; // visual representation pixmap
 
 	int cropSize = 1;
 
@@ -490,9 +579,21 @@ GenImg ContoursGenerator::_generateImage_python()
 
 	const std::string output_path = temp_name + "_out.png";
 	const std::string output_mask_path = temp_mask_name + "_out.png";
+	const std::string field_path = temp_name + "_field.bin";
 
 	try {
+		// generate height field in-process, the script only renders it
+		cv::Mat field = ContoursOperations::generateHeightField(params.width, params.height, params.fractal);
+		{
+			std::ofstream fieldFile(field_path, std::ios::binary);
+			fieldFile.write(reinterpret_cast<const char*>(field.data), field.total() * field.elemSize());
+			if (!fieldFile) {
+				throw std::runtime_error("Failed to write height field.");
+			}
+		}
+
 		const std::string python_command = "py -3.10 generate_contours.py --output " + output_path + " --output_mask " + output_mask_path
+			+ " --field " + field_path
 			+ " --w " + std::to_string(params.width)
 			+ " --h " + std::to_string(params.height)
 			+ " --dpi " + std::to_string(params.dpi)
@@ -523,19 +624,22 @@ GenImg ContoursGenerator::_generateImage_python()
 		if (std::filesystem::exists(output_mask_path)) {
 			std::filesystem::remove(output_mask_path);
 		}
+		if (std::filesystem::exists(field_path)) {
+			std::filesystem::remove(field_path);
+		}
 		throw;
 	}
 
-	QPixmap pixIsolines(QString::fromStdString(output_path));
+	// RGB32, so the wells can be painted whatever format the script wrote
+	QImage imgIsolines = QImage(QString::fromStdString(output_path)).convertToFormat(QImage::Format_RGB32);
 
 	if (params.generateWells) {
-		WellParams wellParams = getUIWellParams();
 		for (int i = 0; i < params.numOfWells; ++i) {
-			DrawOperations::drawRandomWell(pixIsolines, wellParams);
+			DrawOperations::drawRandomWell(imgIsolines, wellParams);
 		}
 	}
 
-	QPixmap pixMask(QString::fromStdString(output_mask_path));
+	QImage imgMask(QString::fromStdString(output_mask_path));
 
 	if (std::filesystem::exists(output_path)) {
 		std::filesystem::remove(output_path);
@@ -543,8 +647,11 @@ GenImg ContoursGenerator::_generateImage_python()
 	if (std::filesystem::exists(output_mask_path)) {
 		std::filesystem::remove(output_mask_path);
 	}
+	if (std::filesystem::exists(field_path)) {
+		std::filesystem::remove(field_path);
+	}
 
-	GenImg result { pixIsolines, pixMask };
+	GenImg result { imgIsolines, imgMask };
 	return result;
 }
 
@@ -565,33 +672,33 @@ WellParams ContoursGenerator::getUIWellParams()
 	return params;
 }
 
-QPixmap utils::cvMat2Pixmap(const cv::Mat& input)
+SharedFrame::SharedFrame(int width, int height)
+	: image(width, height, QImage::Format_RGB32)
 {
-	QImage image;
-	if (input.channels() == 3)
-	{
-		image = QImage((uchar*)input.data, input.cols, input.rows, input.step, QImage::Format_BGR888);
-	}
-	else if (input.channels() == 1)
-	{
-		image = QImage((uchar*)input.data, input.cols, input.rows, input.step, QImage::Format_Grayscale8);
-	}
-	QPixmap cpy = QPixmap::fromImage(image);
-	return cpy;
+	// RGB32 pixels are 0xffRRGGBB, in memory B, G, R, 0xff: a BGRA CV_8UC4 Mat
+	mat = cv::Mat(image.height(), image.width(), CV_8UC4, image.bits(), image.bytesPerLine());
 }
 
-cv::Mat utils::QPixmap2cvMat(const QPixmap& in, bool grayscale)
+SharedFrame SharedFrame::roi(const cv::Rect& rect)
 {
-	QImage im = in.toImage();
-	if (grayscale)
+	SharedFrame view;
+	view.mat = mat(rect);
+	view.image = QImage(view.mat.data, rect.width, rect.height, static_cast<int>(view.mat.step), QImage::Format_RGB32);
+	return view;
+}
+
+void utils::replicateBorder(cv::Mat& frame, int border)
+{
+	// rows first, then whole columns, so the corners take the corner pixel of the inner rect
+	for (int i = 0; i < border; ++i)
 	{
-		im.convertTo(QImage::Format_Grayscale8);
-		return cv::Mat(im.height(), im.width(), CV_8UC1, const_cast<uchar*>(im.bits()), im.bytesPerLine()).clone();
+		frame.row(border).copyTo(frame.row(i));
+		frame.row(frame.rows - 1 - border).copyTo(frame.row(frame.rows - 1 - i));
 	}
-	else
+	for (int i = 0; i < border; ++i)
 	{
-		im.convertTo(QImage::Format_BGR888);
-		return cv::Mat(im.height(), im.width(), CV_8UC3, const_cast<uchar*>(im.bits()), im.bytesPerLine()).clone();
+		frame.col(border).copyTo(frame.col(i));
+		frame.col(frame.cols - 1 - border).copyTo(frame.col(frame.cols - 1 - i));
 	}
 }
 
@@ -12,17 +12,36 @@ struct GenerationParams;
 struct WellParams;
 struct BoundingBox;
 
+// QImage, so a generation can run on any thread; QPixmap is made only for display
 struct GenImg
 {
-    QPixmap image;
-    QPixmap mask;
+    QImage image;
+    QImage mask;
     std::vector<BoundingBox> bboxes;
+    ChainCodeSet contours; // in image coordinates, only with GenerationParams::saveContoursToFile
+};
+
+// One RGB32 pixel buffer seen by QPainter as image and by OpenCV as mat (CV_8UC4, BGRA byte order),
+// both render into the same memory. Move only: painting a shared QImage copy would detach it from mat
+struct SharedFrame
+{
+    SharedFrame() {}
+    SharedFrame(int width, int height);
+    SharedFrame(SharedFrame&&) = default;
+    SharedFrame& operator=(SharedFrame&&) = default;
+    SharedFrame(const SharedFrame&) = delete;
+    SharedFrame& operator=(const SharedFrame&) = delete;
+    // view of rect on the same pixels, valid while this frame lives
+    SharedFrame roi(const cv::Rect& rect);
+
+    QImage image;
+    cv::Mat mat;
 };
 
 namespace utils
 {
-    QPixmap cvMat2Pixmap(const cv::Mat& input);
-    cv::Mat QPixmap2cvMat(const QPixmap& in, bool grayscale);
+    // fills the outer border pixels of frame from the nearest pixel of its inner rect, in place
+    void replicateBorder(cv::Mat& frame, int border);
 }
 
 class ContoursGenerator : public QMainWindow
@@ -44,13 +63,15 @@ protected:
     void initConnections();
     GenerationParams getUIParams();
     GenImg generateImage();
-    GenImg _generateImage_legacy();
-    GenImg _generateImage_python();
+    // no widget access, safe to call from worker threads
+    static GenImg _generateImage_legacy(const GenerationParams& params, const TileParams& tile, const WellParams& wellParams);
+    static GenImg _generateImage_python(const GenerationParams& params, const WellParams& wellParams);
     WellParams getUIWellParams();
-    void saveImage(const QString& folderPath, const QPixmap& img, const QPixmap& mask, const std::vector<BoundingBox>& bboxes);
-    void saveImageSplit(const QString& folderPath, const GenImg& gen);
+    void saveImage(const QString& folderPath, const QImage& img, const QImage& mask, const std::vector<BoundingBox>& bboxes, const ChainCodeSet& contours);
+    void saveImageSplit(const QString& folderPath, const GenImg& gen); // saves 256x256 tiles of one map
     GenerationMode getGenMode();
     FillMode getFillMode();
+    NoiseBackend getNoiseBackend();
 
     template<int size>
     void setSize(); // set image size
@@ -89,7 +110,8 @@ protected:
 
 private:
     Ui::ContoursGeneratorClass *ui;
-    QPixmap m_generatedImage;
-    QPixmap m_generatedMask;
+    QImage m_generatedImage;
+    QImage m_generatedMask;
     std::vector<BoundingBox> m_bboxes;
+    ChainCodeSet m_contours;
 };
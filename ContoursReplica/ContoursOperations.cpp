@@ -1,304 +1,1316 @@
 #include "ContoursOperations.h"
-#include <stack>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 #include "PerlinNoise.hpp"
+#include "ImageKernels.h"
 #include "RandomGenerator.h"
-#include <set>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
 
-cv::Mat ContoursOperations::generateIsolines(const GenerationParams& params)
+// Clamps the noise periods to 1..256, the lattice wraps modulo the period
+static TileParams validTile(TileParams tile)
 {
-	const siv::PerlinNoise::seed_type seed = RandomGenerator::instance().getRandomInt(INT_MAX);
-	const siv::PerlinNoise perlin{ seed };
+	tile.periodX = std::clamp(tile.periodX, 1, 256);
+	tile.periodY = std::clamp(tile.periodY, 1, 256);
+	return tile;
+}
+
+// Noise of one tile for the row kernels; the Perlin permutation is built here, on the baseline
+// instruction set, and kept alive by the caller
+struct TileNoise
+{
+	siv::PerlinNoise::state_type permutation;
+	ImageKernels::Noise noise;
+
+	TileNoise(const GenerationParams& params, const TileParams& tile)
+		: permutation(siv::PerlinNoise(tile.seed).serialize())
+	{
+		noise.permutation = params.noise == NoiseBackend::openSimplex2S ? nullptr : permutation.data();
+		noise.seed = tile.seed;
+		noise.periodX = tile.periodX;
+		noise.periodY = tile.periodY;
+	}
+	TileNoise(const TileNoise&) = delete;
+	TileNoise& operator=(const TileNoise&) = delete;
+};
+
+static void noiseRow(const ImageKernels::Table& kernels, const ImageKernels::Noise& noise, std::int64_t first, float dx, float y, float* out, int count)
+{
+	kernels.noiseRow32(noise, first, dx, y, out, count);
+}
+
+static void noiseRow(const ImageKernels::Table& kernels, const ImageKernels::Noise& noise, std::int64_t first, double dx, double y, double* out, int count)
+{
+	kernels.noiseRow64(noise, first, dx, y, out, count);
+}
+
+// floor(a / b) for b > 0
+static int floorDiv(int a, int b)
+{
+	return (a >= 0 ? a : a - b + 1) / b;
+}
+
+// Exact noise field in [0, 1]; pixel (i, j) of field is the global pixel (x0 + i, y0 + j)
+template <class Float>
+static void sampleNoiseExact(const ImageKernels::Noise& noise, int x0, int y0, Float xMul, Float yMul, cv::Mat& field)
+{
+	const ImageKernels::Table& kernels = ImageKernels::kernels();
+#pragma omp parallel for
+	for (int j = 0; j < field.rows; ++j)
+	{
+		const Float y = static_cast<Float>(y0 + j) * yMul;
+		noiseRow(kernels, noise, x0, xMul, y, field.ptr<Float>(j), field.cols);
+	}
+}
+
+// Noise field sampled every step pixels on a lattice aligned to global coordinates and
+// upsampled with separable Catmull-Rom splines
+template <class Float>
+static void sampleNoiseCoarse(const ImageKernels::Noise& noise, int x0, int y0, Float xMul, Float yMul, int step, cv::Mat& field)
+{
+	const ImageKernels::Table& kernels = ImageKernels::kernels();
+
+	// lattice range covering the field plus the spline support
+	const int kx0 = floorDiv(x0, step) - 1;
+	const int ky0 = floorDiv(y0, step) - 1;
+	const int kx1 = floorDiv(x0 + field.cols - 1, step) + 2;
+	const int ky1 = floorDiv(y0 + field.rows - 1, step) + 2;
+
+	cv::Mat coarse(ky1 - ky0 + 1, kx1 - kx0 + 1, field.type());
+#pragma omp parallel for
+	for (int j = 0; j < coarse.rows; ++j)
+	{
+		const Float y = static_cast<Float>((ky0 + j) * step) * yMul;
+		noiseRow(kernels, noise, kx0, step * xMul, y, coarse.ptr<Float>(j), coarse.cols);
+	}
+
+	// spline weights for every sub-lattice offset
+	std::vector<cv::Vec<Float, 4>> weights(step);
+	for (int r = 0; r < step; ++r)
+	{
+		const Float t = static_cast<Float>(r) / step;
+		const Float t2 = t * t;
+		const Float t3 = t2 * t;
+		weights[r] = cv::Vec<Float, 4>((-t3 + 2 * t2 - t) / 2, (3 * t3 - 5 * t2 + 2) / 2, (-3 * t3 + 4 * t2 + t) / 2, (t3 - t2) / 2);
+	}
+
+	// horizontal pass: every lattice row to full width
+	cv::Mat rows(coarse.rows, field.cols, field.type());
+#pragma omp parallel for
+	for (int j = 0; j < coarse.rows; ++j)
+	{
+		const Float* src = coarse.ptr<Float>(j);
+		Float* dst = rows.ptr<Float>(j);
+		for (int i = 0; i < field.cols; ++i)
+		{
+			const int k = floorDiv(x0 + i, step);
+			const cv::Vec<Float, 4>& w = weights[x0 + i - k * step];
+			const Float* s = src + (k - kx0 - 1);
+			dst[i] = w[0] * s[0] + w[1] * s[1] + w[2] * s[2] + w[3] * s[3];
+		}
+	}
+
+	// vertical pass: 4 full rows with constant weights per output row
+#pragma omp parallel for
+	for (int j = 0; j < field.rows; ++j)
+	{
+		const int k = floorDiv(y0 + j, step);
+		const cv::Vec<Float, 4>& w = weights[y0 + j - k * step];
+		const Float* s0 = rows.ptr<Float>(k - ky0 - 1);
+		const Float* s1 = rows.ptr<Float>(k - ky0);
+		const Float* s2 = rows.ptr<Float>(k - ky0 + 1);
+		const Float* s3 = rows.ptr<Float>(k - ky0 + 2);
+		Float* dst = field.ptr<Float>(j);
+		for (int i = 0; i < field.cols; ++i)
+		{
+			dst[i] = w[0] * s0[i] + w[1] * s1[i] + w[2] * s2[i] + w[3] * s3[i];
+		}
+	}
+}
+
+// Largest |d2/dx2| and |d2/dy2| of noise2D per lattice unit, over every gradient choice and
+// position in a cell (maximized on a fine grid and rounded up)
+static constexpr double perlinCurvature = 20.0;
+static constexpr double openSimplexCurvature = 31.0;
+
+// Catmull-Rom weights w_k at offset t from lattice point 0, k in -1..2: max sum |w_k| and
+// max sum |w_k| (k - t)^2 / 2. The spline reproduces linear functions, so at spacing h its error
+// is sum w_k R_k with |R_k| <= M (k - t)^2 h^2 / 2 for |f''| <= M
+static constexpr double splineGain = 1.25;
+static constexpr double splineError = 0.28125;
+
+static constexpr int maxNoiseStep = 1024;
+
+NoiseSampling ContoursOperations::noiseSampling(const GenerationParams& params)
+{
+	NoiseSampling sampling{ 1, 0.0 };
+	if (params.noiseTolerance <= 0)
+	{
+		return sampling;
+	}
+
+	// noise2D_01 = noise2D / 2 + 1 / 2; the error of the horizontal pass goes through the vertical
+	// weights, so the bound is splineError * step^2 * (splineGain * Mx + My) in isoline levels
+	const double curvature = (params.noise == NoiseBackend::openSimplex2S ? openSimplexCurvature : perlinCurvature) / 2;
+	const double perStep = splineError * curvature * (splineGain * params.Xmul * params.Xmul + params.Ymul * params.Ymul) * params.mul;
+	const double step = std::min(std::floor(std::sqrt(params.noiseTolerance / perStep)), static_cast<double>(maxNoiseStep));
+	if (step > 1)
+	{
+		sampling.step = static_cast<int>(step);
+		sampling.errorBound = perStep * step * step;
+	}
+	return sampling;
+}
+
+// Noise field in [0, 1] at global pixel (x0, y0), exact or coarse within params.noiseTolerance
+template <class Float>
+static void sampleNoise(const ImageKernels::Noise& noise, int x0, int y0, const GenerationParams& params, cv::Mat& field)
+{
+	Float xMul = static_cast<Float>(params.Xmul); // default: 0.005
+	Float yMul = static_cast<Float>(params.Ymul); // default: 0.005
+
+	const NoiseSampling sampling = ContoursOperations::noiseSampling(params);
+	if (sampling.step > 1)
+	{
+		sampleNoiseCoarse(noise, x0, y0, xMul, yMul, sampling.step, field);
+	}
+	else
+	{
+		sampleNoiseExact(noise, x0, y0, xMul, yMul, field);
+	}
+}
+
+// Isoline mask of frac(noise * mul), noise carries a 1 pixel apron around out
+template <class Float>
+static void rasterizeIsolines(const cv::Mat& noise, Float mul, cv::Mat& out)
+{
+	const ImageKernels::Table& kernels = ImageKernels::kernels();
+	const int cols = out.cols;
+	const int band = 64; // output rows per task, keeps the rolling rows in L1/L2
+
+#pragma omp parallel
+	{
+		std::vector<Float> scratch(7 * static_cast<size_t>(cols) + 2);
+
+#pragma omp for schedule(dynamic)
+		for (int b = 0; b < (out.rows + band - 1) / band; ++b)
+		{
+			const int jBegin = b * band;
+			const int jEnd = std::min(out.rows, jBegin + band);
+			const Float* src = noise.ptr<Float>(jBegin);
+			uchar* dst = out.ptr<uchar>(jBegin);
+			if constexpr (std::is_same_v<Float, float>)
+			{
+				kernels.isolineRows32(src, noise.step / sizeof(Float), mul, dst, out.step, cols, jEnd - jBegin, scratch.data());
+			}
+			else
+			{
+				kernels.isolineRows64(src, noise.step / sizeof(Float), mul, dst, out.step, cols, jEnd - jBegin, scratch.data());
+			}
+		}
+	}
+}
+
+// Isoline mask from the analytic noise gradient; also stores the per-pixel gradient of
+// noise * mul into gradient (CV_32FC2)
+template <class Float>
+static void rasterizeIsolinesAnalytic(const ImageKernels::Noise& noise, int x0, int y0, Float xMul, Float yMul, Float mul, cv::Mat& out, cv::Mat& gradient)
+{
+	const ImageKernels::Table& kernels = ImageKernels::kernels();
+	const int cols = out.cols;
+
+#pragma omp parallel
+	{
+		std::vector<Float> scratch(3 * static_cast<size_t>(cols));
+
+#pragma omp for
+		for (int j = 0; j < out.rows; ++j)
+		{
+			float* grad = gradient.ptr<float>(j);
+			if constexpr (std::is_same_v<Float, float>)
+			{
+				kernels.analyticIsolineRow32(noise, x0, y0 + j, xMul, yMul, mul, out.ptr<uchar>(j), grad, scratch.data(), cols);
+			}
+			else
+			{
+				kernels.analyticIsolineRow64(noise, x0, y0 + j, xMul, yMul, mul, out.ptr<uchar>(j), grad, scratch.data(), cols);
+			}
+		}
+	}
+}
+
+template <class Float>
+cv::Mat ContoursOperations::generateIsolines(const GenerationParams& params, cv::Mat* gradient)
+{
+	TileParams tile;
+	tile.seed = RandomGenerator::instance().getRandomInt(INT_MAX);
+
+	return generateIsolines<Float>(params, tile, gradient);
+}
+
+template <class Float>
+cv::Mat ContoursOperations::generateIsolines(const GenerationParams& params, const TileParams& tileParams, cv::Mat* gradient)
+{
+	const TileParams tile = validTile(tileParams);
+	const TileNoise tileNoise(params, tile);
+
+	if (params.analyticGradient)
+	{
+		// exact samples only, the gradient replaces the Sobel neighbourhood so no apron is needed
+		cv::Mat isolines(params.width, params.height, CV_8UC1);
+		cv::Mat grad(params.width, params.height, CV_32FC2);
+		rasterizeIsolinesAnalytic(tileNoise.noise, tile.x, tile.y, static_cast<Float>(params.Xmul), static_cast<Float>(params.Ymul), static_cast<Float>(params.mul), isolines, grad);
+		if (gradient)
+		{
+			*gradient = grad;
+		}
+		return isolines;
+	}
+
+	// 1 pixel apron so that the Sobel pass sees the neighbouring tiles' samples
+	const int apron = 1;
+
+	cv::Mat n(params.width + 2 * apron, params.height + 2 * apron, cv::DataType<Float>::type);
+
+	Float mul = static_cast<Float>(params.mul); // default: 20
+
+	sampleNoise<Float>(tileNoise.noise, tile.x - apron, tile.y - apron, params, n);
+
+	cv::Mat isolines(params.width, params.height, CV_8UC1);
+	rasterizeIsolines(n, mul, isolines);
+
+	return isolines;
+}
+
+template cv::Mat ContoursOperations::generateIsolines<float>(const GenerationParams& params, cv::Mat* gradient);
+template cv::Mat ContoursOperations::generateIsolines<double>(const GenerationParams& params, cv::Mat* gradient);
+template cv::Mat ContoursOperations::generateIsolines<float>(const GenerationParams& params, const TileParams& tile, cv::Mat* gradient);
+template cv::Mat ContoursOperations::generateIsolines<double>(const GenerationParams& params, const TileParams& tile, cv::Mat* gradient);
+
+template <class Float>
+cv::Mat ContoursOperations::generateNoiseField(const GenerationParams& params)
+{
+	TileParams tile;
+	tile.seed = RandomGenerator::instance().getRandomInt(INT_MAX);
+
+	return generateNoiseField<Float>(params, tile);
+}
+
+template <class Float>
+cv::Mat ContoursOperations::generateNoiseField(const GenerationParams& params, const TileParams& tileParams)
+{
+	const TileParams tile = validTile(tileParams);
+	const TileNoise tileNoise(params, tile);
+
+	cv::Mat field(params.width, params.height, cv::DataType<Float>::type);
+	sampleNoise<Float>(tileNoise.noise, tile.x, tile.y, params, field);
+	field *= params.mul;
+
+	return field;
+}
+
+template cv::Mat ContoursOperations::generateNoiseField<float>(const GenerationParams& params);
+template cv::Mat ContoursOperations::generateNoiseField<double>(const GenerationParams& params);
+template cv::Mat ContoursOperations::generateNoiseField<float>(const GenerationParams& params, const TileParams& tile);
+template cv::Mat ContoursOperations::generateNoiseField<double>(const GenerationParams& params, const TileParams& tile);
+
+// Writes index + 1 of contour i of contours to its pixels of the label plane (if any)
+static void labelContour(const ContourSet& contours, size_t i, cv::Mat* labels)
+{
+	if (labels)
+	{
+		const int label = static_cast<int>(i + 1);
+		for (const cv::Point& pt : contours.contourPoints(i))
+		{
+			labels->at<int>(pt) = label;
+		}
+	}
+}
+
+template <class Float>
+void marchingSquaresImpl(const cv::Mat& field, ContourSet& contours, cv::Mat* labels)
+{
+	// a crossing of one level on one pixel edge, shared by the (at most) two cells of the edge
+	struct Node
+	{
+		cv::Point2f pt;
+		int seg[2];
+	};
+	struct Segment
+	{
+		std::uint64_t key[2];
+		int level;
+	};
+
+	std::unordered_map<std::uint64_t, Node> nodes;
+	std::vector<Segment> segments;
+
+	const int cols = field.cols;
+	auto edgeKey = [cols](int x, int y, bool vertical, int level) -> std::uint64_t
+		{
+			return (((static_cast<std::uint64_t>(y) * cols + x) * 2 + (vertical ? 1 : 0)) << 20) | static_cast<std::uint64_t>(level & 0xFFFFF);
+		};
+
+	for (int y = 0; y + 1 < field.rows; ++y)
+	{
+		const Float* r0 = field.ptr<Float>(y);
+		const Float* r1 = field.ptr<Float>(y + 1);
+		for (int x = 0; x + 1 < cols; ++x)
+		{
+			// corners: top-left, top-right, bottom-right, bottom-left
+			const Float a = r0[x];
+			const Float b = r0[x + 1];
+			const Float c = r1[x + 1];
+			const Float d = r1[x];
+			const Float lo = std::min(std::min(a, b), std::min(c, d));
+			const Float hi = std::max(std::max(a, b), std::max(c, d));
+
+			// levels with lo < level <= hi
+			for (int level = static_cast<int>(std::floor(lo)) + 1; level <= hi; ++level)
+			{
+				const int caseIndex = (a >= level ? 1 : 0) | (b >= level ? 2 : 0) | (c >= level ? 4 : 0) | (d >= level ? 8 : 0);
+
+				// edges: top, right, bottom, left
+				auto crossing = [&](int edge) -> std::uint64_t
+					{
+						std::uint64_t key;
+						cv::Point2f pt;
+						switch (edge)
+						{
+						case 0:
+							key = edgeKey(x, y, false, level);
+							pt = cv::Point2f(x + static_cast<float>((level - a) / (b - a)), static_cast<float>(y));
+							break;
+						case 1:
+							key = edgeKey(x + 1, y, true, level);
+							pt = cv::Point2f(static_cast<float>(x + 1), y + static_cast<float>((level - b) / (c - b)));
+							break;
+						case 2:
+							key = edgeKey(x, y + 1, false, level);
+							pt = cv::Point2f(x + static_cast<float>((level - d) / (c - d)), static_cast<float>(y + 1));
+							break;
+						default:
+							key = edgeKey(x, y, true, level);
+							pt = cv::Point2f(static_cast<float>(x), y + static_cast<float>((level - a) / (d - a)));
+							break;
+						}
+						Node& node = nodes.try_emplace(key, Node{ pt, { -1, -1 } }).first->second;
+						node.seg[node.seg[0] < 0 ? 0 : 1] = static_cast<int>(segments.size());
+						return key;
+					};
+				auto addSegment = [&](int e0, int e1)
+					{
+						Segment seg;
+						seg.key[0] = crossing(e0);
+						seg.key[1] = crossing(e1);
+						seg.level = level;
+						segments.push_back(seg);
+					};
+
+				if (caseIndex == 5 || caseIndex == 10)
+				{
+					// saddle: the cell centre decides which corners are connected
+					const bool centreAbove = (a + b + c + d) / 4 >= level;
+					if ((caseIndex == 5) == centreAbove)
+					{
+						addSegment(0, 1);
+						addSegment(2, 3);
+					}
+					else
+					{
+						addSegment(0, 3);
+						addSegment(1, 2);
+					}
+				}
+				else
+				{
+					int edges[2] = { 0, 0 };
+					int n = 0;
+					const bool above[4] = { (caseIndex & 1) != 0, (caseIndex & 2) != 0, (caseIndex & 4) != 0, (caseIndex & 8) != 0 };
+					if (above[0] != above[1]) edges[n++] = 0;
+					if (above[1] != above[2]) edges[n++] = 1;
+					if (above[3] != above[2]) edges[n++] = 2;
+					if (above[0] != above[3]) edges[n++] = 3;
+					addSegment(edges[0], edges[1]);
+				}
+			}
+		}
+	}
+
+	// link segments into polylines, open ones (ending on the image border) first
+	std::vector<bool> used(segments.size(), false);
+	auto walk = [&](int first, std::uint64_t from)
+		{
+			const size_t firstPoint = contours.points.size();
+			bool isClosed = false;
+			contours.vertices.push_back(nodes.at(from).pt);
+
+			int cur = first;
+			std::uint64_t key = from;
+			while (true)
+			{
+				used[cur] = true;
+				key = segments[cur].key[0] == key ? segments[cur].key[1] : segments[cur].key[0];
+				const Node& node = nodes.at(key);
+				contours.vertices.push_back(node.pt);
+				if (key == from)
+				{
+					isClosed = true;
+					break;
+				}
+				const int next = node.seg[0] == cur ? node.seg[1] : node.seg[0];
+				if (next < 0 || used[next])
+				{
+					break;
+				}
+				cur = next;
+			}
+
+			// 8-connected pixel chain for the raster stages
+			const size_t firstVertex = contours.vertexOffsets.back();
+			for (size_t i = firstVertex; i + 1 < contours.vertices.size(); ++i)
+			{
+				const cv::Point2f& v0 = contours.vertices[i];
+				const cv::Point2f& v1 = contours.vertices[i + 1];
+				cv::LineIterator it(cv::Point(cvRound(v0.x), cvRound(v0.y)), cv::Point(cvRound(v1.x), cvRound(v1.y)), 8);
+				for (int k = 0; k < it.count; ++k, ++it)
+				{
+					if (contours.points.size() == firstPoint || contours.points.back() != it.pos())
+					{
+						contours.points.push_back(it.pos());
+					}
+				}
+			}
+			if (isClosed && contours.points.size() - firstPoint > 1 && contours.points.back() == contours.points[firstPoint])
+			{
+				contours.points.pop_back();
+			}
+
+			contours.addContour(isClosed, segments[first].level);
+			labelContour(contours, contours.size() - 1, labels);
+		};
 
-	cv::Mat grad;
-	cv::Mat n(params.width, params.height, CV_64FC1);
+	for (size_t s = 0; s < segments.size(); ++s)
+	{
+		for (int end = 0; end < 2 && !used[s]; ++end)
+		{
+			if (nodes.at(segments[s].key[end]).seg[1] < 0)
+			{
+				walk(static_cast<int>(s), segments[s].key[end]);
+			}
+		}
+	}
+	for (size_t s = 0; s < segments.size(); ++s)
+	{
+		if (!used[s])
+		{
+			walk(static_cast<int>(s), segments[s].key[0]);
+		}
+	}
+}
+
+void ContoursOperations::marchingSquares(const cv::Mat& field, ContourSet& contours, cv::Mat* labels)
+{
+	if (labels)
+	{
+		*labels = cv::Mat::zeros(field.size(), CV_32SC1);
+	}
+
+	if (field.depth() == CV_64F)
+	{
+		marchingSquaresImpl<double>(field, contours, labels);
+	}
+	else
+	{
+		marchingSquaresImpl<float>(field, contours, labels);
+	}
+}
+
+cv::Mat ContoursOperations::generateHeightField(int width, int height, const FractalParams& fractal)
+{
+	const siv::BasicPerlinNoise<float>::seed_type seed = RandomGenerator::instance().getRandomInt(INT_MAX);
+	const siv::BasicPerlinNoise<float> perlin{ seed };
 
-	double xMul = params.Xmul; // default: 0.005
-	double yMul = params.Ymul; // default: 0.005
-	int mul = params.mul; // default: 20
+	cv::Mat field(height, width, CV_32FC1);
 
+#pragma omp parallel
+	{
+		std::vector<float> octave(width);
+
+#pragma omp for
+		for (int j = 0; j < height; ++j)
+		{
+			float* row = field.ptr<float>(j);
+			std::fill(row, row + width, 0.0f);
+
+			float frequency = 1.0f / fractal.scale;
+			float amplitude = 1.0f;
+			for (int o = 0; o < fractal.octaves; ++o)
+			{
+				perlin.noise2D_row(0.0f, frequency, j * frequency, octave.data(), width);
+				for (int i = 0; i < width; ++i)
+				{
+					row[i] += octave[i] * amplitude;
+				}
+				frequency *= fractal.lacunarity;
+				amplitude *= fractal.persistence;
+			}
+		}
+	}
+
+	cv::normalize(field, field, 0.0, 1.0, cv::NORM_MINMAX);
+
+	return field;
+}
+
+// Guo-Hall thinning on rows packed into 64 pixel words; the row kernels decide 64 pixels at once,
+// bands of rows that did not change and whose neighbours did not change are skipped
+void ContoursOperations::thinning(const cv::Mat& src, cv::Mat& dst)
+{
+	const ImageKernels::Table& kernels = ImageKernels::kernels();
+	const int rows = src.rows;
+	const int cols = src.cols;
+	const int words = (cols + 63) / 64;
+	const int band = 32; // rows per band, the unit of parallel work and convergence tracking
+	const int bands = (rows + band - 1) / band;
+
+	// foreground is >= 128, like the division by 255 in OpenCV
+	std::vector<std::uint64_t> img(static_cast<size_t>(rows) * words, 0);
+	std::vector<std::uint64_t> marker(img.size(), 0);
 #pragma omp parallel for
-	for (int j = 0; j < n.rows; ++j)
+	for (int j = 0; j < rows; ++j)
 	{
-		for (int i = 0; i < n.cols; ++i)
+		kernels.packMaskRow(src.ptr<uchar>(j), &img[static_cast<size_t>(j) * words], cols);
+	}
+
+	// only pixels with a full 3x3 neighbourhood are ever removed
+	std::vector<std::uint64_t> interior(words, 0);
+	for (int i = 1; i < cols - 1; ++i)
+	{
+		interior[i / 64] |= std::uint64_t(1) << (i % 64);
+	}
+
+	// dirty[pass][b]: band b may lose pixels in that pass, because it or a neighbouring band
+	// changed since the pass last ran on it
+	std::vector<char> dirty[2] = { std::vector<char>(bands, 1), std::vector<char>(bands, 1) };
+	std::vector<char> changed(bands, 0);
+
+	bool active = true;
+	while (active)
+	{
+		active = false;
+		for (int pass = 0; pass < 2; ++pass)
+		{
+#pragma omp parallel for schedule(dynamic)
+			for (int b = 0; b < bands; ++b)
+			{
+				changed[b] = dirty[pass][b] && kernels.thinningRows(img.data(), marker.data(), interior.data(), words,
+					std::max(1, b * band), std::min(rows - 1, (b + 1) * band), pass);
+			}
+
+			// apply after all bands have been decided, every decision sees the same image
+#pragma omp parallel for
+			for (int b = 0; b < bands; ++b)
+			{
+				if (!changed[b])
+				{
+					continue;
+				}
+				for (int j = std::max(1, b * band); j < std::min(rows - 1, (b + 1) * band); ++j)
+				{
+					for (int w = 0; w < words; ++w)
+					{
+						img[static_cast<size_t>(j) * words + w] &= ~marker[static_cast<size_t>(j) * words + w];
+					}
+				}
+			}
+
+			for (int b = 0; b < bands; ++b)
+			{
+				dirty[pass][b] = 0;
+			}
+			for (int b = 0; b < bands; ++b)
+			{
+				if (changed[b])
+				{
+					active = true;
+					for (int k = std::max(0, b - 1); k <= std::min(bands - 1, b + 1); ++k)
+					{
+						dirty[0][k] = dirty[1][k] = 1;
+					}
+				}
+			}
+		}
+	}
+
+	dst.create(rows, cols, CV_8UC1);
+#pragma omp parallel for
+	for (int j = 0; j < rows; ++j)
+	{
+		const std::uint64_t* in = &img[static_cast<size_t>(j) * words];
+		uchar* out = dst.ptr<uchar>(j);
+		for (int i = 0; i < cols; ++i)
 		{
-			double noise = perlin.noise2D_01(i * xMul, j * yMul) * mul;
-			int nnn = (int)ceil(noise);
-			noise = noise - floor(noise);
-			n.at<double>(j, i) = noise;
+			out[i] = ((in[i / 64] >> (i % 64)) & 1) ? 255 : 0;
 		}
 	}
+}
+
+// Neighbours to try, in order, after arriving at a pixel from a direction: straight on first,
+// then ever wider turns; the pixel behind is skipped. NONE (start of a trace) tries all 8.
+struct NeighbourOrder
+{
+	int count;
+	int dx[8];
+	int dy[8];
+};
+
+static constexpr NeighbourOrder neighbourOrder[9] = {
+	{ 7, { 0, 1, -1, 1, -1, 1, -1 }, { -1, -1, -1, 0, 0, 1, 1 } }, // TOP
+	{ 7, { 1, 0, 1, -1, 1, 0, -1 }, { -1, -1, 0, -1, 1, 1, 0 } }, // TOP_RIGHT
+	{ 7, { 1, 1, 1, 0, 0, -1, -1 }, { 0, -1, 1, -1, 1, -1, 1 } }, // RIGHT
+	{ 7, { 1, 1, 0, 1, -1, -1, 0 }, { 1, 0, 1, -1, 1, 0, -1 } }, // BOTTOM_RIGHT
+	{ 7, { 0, 1, -1, 1, -1, 1, -1 }, { 1, 1, 1, 0, 0, -1, -1 } }, // DOWN
+	{ 7, { -1, 0, -1, 1, -1, 0, 1 }, { 1, 1, 0, 1, -1, -1, 0 } }, // BOTTOM_LEFT
+	{ 7, { -1, -1, -1, 0, 0, 1, 1 }, { 0, 1, -1, 1, -1, 1, -1 } }, // LEFT
+	{ 7, { -1, 0, -1, 1, -1, 0, 1 }, { -1, -1, 0, -1, 1, 1, 0 } }, // TOP_LEFT
+	{ 8, { 0, 1, -1, 1, -1, 1, -1, 0 }, { -1, -1, -1, 0, 0, 1, 1, 1 } } // NONE
+};
+
+// Direction of a step (dx, dy) in -1..1, indexed by (dy + 1) * 3 + (dx + 1)
+static constexpr Direction stepDirection[9] = {
+	Direction::TOP_LEFT, Direction::TOP, Direction::TOP_RIGHT,
+	Direction::LEFT, Direction::NONE, Direction::RIGHT,
+	Direction::BOTTOM_LEFT, Direction::DOWN, Direction::BOTTOM_RIGHT
+};
 
-	cv::Mat grad_x, grad_y;
-	cv::Mat abs_grad_x, abs_grad_y;
-	cv::Sobel(n, grad_x, CV_64FC1, 1, 0);
-	cv::Sobel(n, grad_y, CV_64FC1, 0, 1);
-	cv::convertScaleAbs(grad_x, abs_grad_x);
-	cv::convertScaleAbs(grad_y, abs_grad_y);
-	cv::addWeighted(abs_grad_x, 0.5, abs_grad_y, 0.5, 0, grad);
+// Index of the lowest set bit of a non-zero mask
+static inline int lowestBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
 
-	cv::Mat normalized;
-	n.convertTo(normalized, CV_8UC1, 255, 0);
-	grad.forEach<uchar>([](uchar& u, const int* pos)
+// First x >= from in row with a 255 pixel, or width
+static int findContourPixel(const uchar* row, int from, int width)
+{
+	int x = from;
+#if defined(__SSE2__) || defined(_M_X64)
+	const __m128i value = _mm_set1_epi8(static_cast<char>(255));
+	for (; x + 16 <= width; x += 16)
+	{
+		const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)), value));
+		if (mask)
 		{
-			if (u == 1)
-				u = 0;
-			else if (u > 1)
+			return x + lowestBit(static_cast<unsigned int>(mask));
+		}
+	}
+#endif
+	for (; x < width; ++x)
+	{
+		if (row[x] == 255)
+		{
+			return x;
+		}
+	}
+	return width;
+}
+
+// A traced line counts as closed when its two ends are (nearly) neighbours
+static bool endsMeet(const cv::Point& front, const cv::Point& back)
+{
+	return cv::norm(front - back) <= 3;
+}
+
+// Traces every contour of mat (consumed) in raster order of their first pixel, y shifted by yOffset;
+// seeds (optional) receives the pixel each trace started from
+static void traceContours(cv::Mat& mat, int yOffset, ContourSet& contours, cv::Mat* labels, std::vector<cv::Point>* seeds = nullptr)
+{
+	for (int m = 0; m < mat.rows; ++m)
+	{
+		const uchar* row = mat.ptr<uchar>(m);
+		for (int n = findContourPixel(row, 0, mat.cols); n < mat.cols; n = findContourPixel(row, n + 1, mat.cols))
+		{
+			const size_t first = contours.points.size();
+			ContoursOperations::extractContour(n, m, mat, contours.points);
+			if (yOffset != 0)
+			{
+				for (size_t i = first; i < contours.points.size(); ++i)
+				{
+					contours.points[i].y += yOffset;
+				}
+			}
+			contours.addContour(endsMeet(contours.points[first], contours.points.back()));
+			labelContour(contours, contours.size() - 1, labels);
+			if (seeds)
 			{
-				u = 255;
+				seeds->emplace_back(n, m + yOffset);
 			}
-		});
-	cv::Mat gradInv = cv::Scalar(255) - grad;
+		}
+	}
+}
 
-	return gradInv;
+void ContoursOperations::findContours(const cv::Mat& img, ContourSet& contours, cv::Mat* labels)
+{
+	if (labels)
+	{
+		*labels = cv::Mat::zeros(img.size(), CV_32SC1);
+	}
+
+	cv::Mat mat = img.clone();
+	traceContours(mat, 0, contours, labels);
 }
 
-void ContoursOperations::findContours(const cv::Mat& img, std::vector<Contour>& contours)
+void ContoursOperations::findContoursParallel(const cv::Mat& img, ContourSet& contours, cv::Mat* labels, int tileRows)
 {
-	int width = img.cols;
-	int height = img.rows;
+	CV_Assert(tileRows > 0);
+
+	if (labels)
+	{
+		*labels = cv::Mat::zeros(img.size(), CV_32SC1);
+	}
 
+	const int height = img.rows;
+	const int tiles = (height + tileRows - 1) / tileRows;
+
+	// every tile traces its own rows of one shared copy, a row range view bounds the tracer
 	cv::Mat mat = img.clone();
-	for (int m = 0; m < height; ++m)
+	std::vector<ContourSet> tileFragments(tiles);
+	std::vector<std::vector<cv::Point>> tileSeeds(tiles);
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < tiles; ++t)
+	{
+		cv::Mat band = mat.rowRange(t * tileRows, std::min(height, (t + 1) * tileRows));
+		traceContours(band, t * tileRows, tileFragments[t], nullptr, &tileSeeds[t]);
+	}
+
+	// fragments numbered tile by tile
+	std::vector<Span<cv::Point>> fragments;
+	std::vector<cv::Point> seeds;
+	std::vector<int> firstFragment(tiles + 1, 0);
+	for (int t = 0; t < tiles; ++t)
+	{
+		firstFragment[t] = static_cast<int>(fragments.size());
+		for (size_t i = 0; i < tileFragments[t].size(); ++i)
+		{
+			fragments.push_back(tileFragments[t].contourPoints(i));
+		}
+		seeds.insert(seeds.end(), tileSeeds[t].begin(), tileSeeds[t].end());
+	}
+	firstFragment[tiles] = static_cast<int>(fragments.size());
+
+	// A fragment is exactly what the single-band tracer gives unless its 8-connected component
+	// of pixels reaches over a band border: the tracer never leaves a component, and a component
+	// inside one band is visited in the same raster order. Fragments are grouped into components
+	// (fragment index + 1 per pixel, in the label plane if there is one), and the components
+	// crossing a border are traced again as a whole.
+	cv::Mat localIds;
+	cv::Mat& ids = labels ? *labels : localIds;
+	if (!labels)
+	{
+		ids = cv::Mat::zeros(img.size(), CV_32SC1);
+	}
+
+	std::vector<int> parent(fragments.size());
+	for (size_t f = 0; f < parent.size(); ++f)
+	{
+		parent[f] = static_cast<int>(f);
+	}
+	auto find = [&](int f)
+		{
+			while (parent[f] != f)
+			{
+				parent[f] = parent[parent[f]];
+				f = parent[f];
+			}
+			return f;
+		};
+	auto unite = [&](int a, int b)
+		{
+			a = find(a);
+			b = find(b);
+			if (a != b)
+			{
+				parent[std::max(a, b)] = std::min(a, b);
+			}
+		};
+
+	// within a band only that band's fragments are touched, so bands run concurrently
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < tiles; ++t)
 	{
-		for (int n = 0; n < width; ++n)
+		for (int f = firstFragment[t]; f < firstFragment[t + 1]; ++f)
+		{
+			for (const cv::Point& pt : fragments[f])
+			{
+				ids.at<int>(pt) = f + 1;
+			}
+		}
+
+		const int bandEnd = std::min(height, (t + 1) * tileRows);
+		for (int f = firstFragment[t]; f < firstFragment[t + 1]; ++f)
 		{
-			if (mat.at<uchar>(m, n) == 255)
+			for (const cv::Point& pt : fragments[f])
 			{
-				Contour c;
-				extractContour(n, m, mat, c.points);
-				contours.push_back(std::move(c));
+				// forward half of the 8-neighbourhood, inside the band
+				static const int dx[4] = { 1, -1, 0, 1 };
+				static const int dy[4] = { 0, 1, 1, 1 };
+				for (int k = 0; k < 4; ++k)
+				{
+					const int x = pt.x + dx[k];
+					const int y = pt.y + dy[k];
+					if (x >= 0 && x < img.cols && y < bandEnd)
+					{
+						const int id = ids.at<int>(y, x);
+						if (id != 0 && id - 1 != f)
+						{
+							unite(f, id - 1);
+						}
+					}
+				}
 			}
 		}
 	}
 
-	for (size_t i = 0; i < contours.size(); ++i)
+	// pixel pairs across each border join their components, which are then traced again
+	std::vector<int> crossing;
+	for (int t = 0; t + 1 < tiles; ++t)
 	{
-		Contour& c = contours[i];
-		c.index = i;
-		c.value = i + 1;
+		const int border = (t + 1) * tileRows;
+		const int* upper = ids.ptr<int>(border - 1);
+		const int* lower = ids.ptr<int>(border);
+		for (int x = 0; x < img.cols; ++x)
+		{
+			if (upper[x] == 0)
+			{
+				continue;
+			}
+			for (int nx = std::max(0, x - 1); nx <= std::min(img.cols - 1, x + 1); ++nx)
+			{
+				if (lower[nx] != 0)
+				{
+					unite(upper[x] - 1, lower[nx] - 1);
+					crossing.push_back(upper[x] - 1);
+				}
+			}
+		}
+	}
 
-		bool isClosed = true;
+	// components to trace again, numbered in order of their smallest fragment
+	std::vector<int> component(fragments.size(), -1);
+	for (int f : crossing)
+	{
+		component[find(f)] = 0;
+	}
+	std::vector<std::vector<cv::Point>> componentPixels;
+	for (int f = 0; f < static_cast<int>(fragments.size()); ++f)
+	{
+		const int root = find(f);
+		if (component[root] < 0)
+		{
+			continue;
+		}
+		if (root == f)
+		{
+			component[f] = static_cast<int>(componentPixels.size());
+			componentPixels.emplace_back();
+		}
+		component[f] = component[root];
+		componentPixels[component[f]].insert(componentPixels[component[f]].end(), fragments[f].begin(), fragments[f].end());
+	}
 
-		if (cv::norm(contours[i].points.front() - contours[i].points.back()) > 3)
+	// band tracing consumed every pixel of mat; each crossing component is put back and traced from
+	// its pixels in raster order. Components never touch, so they are traced concurrently
+	auto raster = [](const cv::Point& a, const cv::Point& b) { return std::make_pair(a.y, a.x) < std::make_pair(b.y, b.x); };
+	const int components = static_cast<int>(componentPixels.size());
+	std::vector<ContourSet> retraced(components);
+	std::vector<std::vector<cv::Point>> retracedSeeds(components);
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < components; ++c)
+	{
+		std::vector<cv::Point>& pixels = componentPixels[c];
+		std::sort(pixels.begin(), pixels.end(), raster);
+		for (const cv::Point& pt : pixels)
+		{
+			mat.at<uchar>(pt) = 255;
+		}
+		for (const cv::Point& pt : pixels)
 		{
-			isClosed = false;
+			if (mat.at<uchar>(pt) == 255)
+			{
+				ContoursOperations::extractContour(pt.x, pt.y, mat, retraced[c].points);
+				retraced[c].addContour(false);
+				retracedSeeds[c].push_back(pt);
+			}
 		}
+	}
 
-		c.isClosed = isClosed;
+	// kept fragments and traced components in raster order of their seeds, as the single-band tracer emits them
+	std::vector<std::pair<cv::Point, Span<cv::Point>>> order;
+	size_t pointCount = 0;
+	for (size_t f = 0; f < fragments.size(); ++f)
+	{
+		if (component[f] < 0)
+		{
+			order.emplace_back(seeds[f], fragments[f]);
+			pointCount += fragments[f].size();
+		}
+	}
+	for (int c = 0; c < components; ++c)
+	{
+		for (size_t i = 0; i < retraced[c].size(); ++i)
+		{
+			order.emplace_back(retracedSeeds[c][i], retraced[c].contourPoints(i));
+		}
+		pointCount += retraced[c].points.size();
+	}
+	std::sort(order.begin(), order.end(), [&](const auto& a, const auto& b) { return raster(a.first, b.first); });
 
-		c.boundingRect = cv::boundingRect(contours[i].points);
+	// every pixel of the id plane is overwritten by its final label
+	contours.reserve(contours.size() + order.size(), contours.points.size() + pointCount);
+	for (const auto& entry : order)
+	{
+		const Span<cv::Point>& points = entry.second;
+		contours.points.insert(contours.points.end(), points.begin(), points.end());
+		contours.addContour(endsMeet(points.front(), points.back()));
+		labelContour(contours, contours.size() - 1, labels);
 	}
 }
 
 void ContoursOperations::extractContour(int x_start, int y_start, cv::Mat& img, std::vector<cv::Point>& contour)
 {
-	int width = img.cols;
-	int height = img.rows;
+	const unsigned int width = img.cols;
+	const unsigned int height = img.rows;
+	uchar* const data = img.data;
+	const size_t step = img.step;
 
+	// follow the line greedily from the start pixel, then once more from the start in the
+	// other direction; the first half is reversed so the points run end to end
 	int x = x_start;
 	int y = y_start;
-
-	auto isContour = [&](int x, int y) -> bool
-		{
-			if (x < 0 || x >= width || y < 0 || y >= height)
-			{
-				return false;
-			}
-			return img.at<uchar>(y, x) == 255;
-		};
-
-	std::stack<cv::Point> stack;
-
-	stack.push(cv::Point(x, y));
-
-	Direction direction = Direction::NONE;
-
-	cv::Point prev_point = cv::Point(x, y);
-
+	int prev_x = x;
+	int prev_y = y;
 	bool reverse = false;
+	bool next = true;
+	const size_t first = contour.size();
 
-	while (!stack.empty())
+	while (next)
 	{
-		cv::Point p = stack.top();
-		stack.pop();
-
-		if (img.at<uchar>(p.y, p.x) == 255)
+		uchar* pixel = data + y * step + x;
+		if (*pixel == 255)
 		{
-			contour.push_back(p);
-			img.at<uchar>(p.y, p.x) = 0;
+			contour.emplace_back(x, y);
+			*pixel = 0;
 		}
 
-		direction = getDirection(prev_point, p);
+		const NeighbourOrder& order = neighbourOrder[static_cast<int>(stepDirection[(y - prev_y + 1) * 3 + (x - prev_x + 1)])];
 
-		std::vector<cv::Point> neighbours = getOrder(p, direction);
+		prev_x = x;
+		prev_y = y;
+		next = false;
 
-		for (const auto& n : neighbours)
+		for (int k = 0; k < order.count; ++k)
 		{
-			if (isContour(n.x, n.y))
+			const int nx = x + order.dx[k];
+			const int ny = y + order.dy[k];
+			if (static_cast<unsigned int>(nx) < width && static_cast<unsigned int>(ny) < height && data[ny * step + nx] == 255)
 			{
-				stack.push(n);
+				x = nx;
+				y = ny;
+				next = true;
 				break;
 			}
 		}
 
-		prev_point = p;
-
-		if (stack.empty())
+		if (!next && !reverse)
 		{
-			if (!reverse)
-			{
-				reverse = true;
-
-				cv::Point point(x, y);
-
-				stack.push(point);
-				std::reverse(contour.begin(), contour.end());
-				prev_point = point;
-			}
+			reverse = true;
+			std::reverse(contour.begin() + first, contour.end());
+			x = prev_x = x_start;
+			y = prev_y = y_start;
+			next = true;
 		}
 	}
 }
 
 Direction ContoursOperations::getDirection(cv::Point prev, cv::Point next)
 {
-	Direction direction = Direction::NONE;
 	cv::Point dir = next - prev;
-	if (dir.x != 0 && dir.y != 0)
-	{
-		if (dir.x > 0 && dir.y > 0)
-		{
-			direction = Direction::BOTTOM_RIGHT;
-		}
-		else if (dir.x > 0 && dir.y < 0)
-		{
-			direction = Direction::TOP_RIGHT;
-		}
-		else if (dir.x < 0 && dir.y > 0)
-		{
-			direction = Direction::BOTTOM_LEFT;
-		}
-		else if (dir.x < 0 && dir.y < 0)
-		{
-			direction = Direction::TOP_LEFT;
-		}
-	}
-	else if (dir.x != 0)
-	{
-		if (dir.x > 0)
-		{
-			direction = Direction::RIGHT;
-		}
-		else
-		{
-			direction = Direction::LEFT;
-		}
-	}
-	else if (dir.y != 0)
-	{
-		if (dir.y > 0)
-		{
-			direction = Direction::DOWN;
-		}
-		else
-		{
-			direction = Direction::TOP;
-		}
-	}
-	return direction;
+	const int dx = (dir.x > 0) - (dir.x < 0);
+	const int dy = (dir.y > 0) - (dir.y < 0);
+	return stepDirection[(dy + 1) * 3 + (dx + 1)];
 }
 
 std::vector<cv::Point> ContoursOperations::getOrder(cv::Point pt, Direction direction)
 {
-	switch (direction)
+	const NeighbourOrder& order = neighbourOrder[static_cast<int>(direction)];
+	std::vector<cv::Point> neighbours;
+	neighbours.reserve(order.count);
+	for (int k = 0; k < order.count; ++k)
 	{
-	case Direction::TOP:
-		return { cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1) };
-	case Direction::TOP_RIGHT:
-		return { cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y) };
-	case Direction::RIGHT:
-		return { cv::Point(pt.x + 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1) };
-	case Direction::BOTTOM_RIGHT:
-		return { cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x, pt.y - 1) };
-	case Direction::DOWN:
-		return { cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1) };
-	case Direction::BOTTOM_LEFT:
-		return { cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y) };
-	case Direction::LEFT:
-		return { cv::Point(pt.x - 1, pt.y), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x + 1, pt.y - 1) };
-	case Direction::TOP_LEFT:
-		return { cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y) };
-	default:
-		return { cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1) };
+		neighbours.emplace_back(pt.x + order.dx[k], pt.y + order.dy[k]);
 	}
+	return neighbours;
 }
 
-void ContoursOperations::findDepth(cv::Mat& img, std::vector<Contour>& contours)
+void ContoursOperations::encodeChainCodes(const ContourSet& contours, ChainCodeSet& codes)
 {
-	int width = img.cols;
-	int height = img.rows;
+	size_t words = codes.words.size();
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		words += (contours.offsets[i + 1] - contours.offsets[i] + ChainCode::stepsPerWord - 1) / ChainCode::stepsPerWord;
+	}
+	codes.words.reserve(words);
+	codes.start.reserve(codes.start.size() + contours.size());
+	codes.runCount.reserve(codes.runCount.size() + contours.size());
+	codes.wordOffsets.reserve(codes.wordOffsets.size() + contours.size());
+	codes.runOffsets.reserve(codes.size() + contours.size() + 1);
+	codes.count.reserve(codes.size() + contours.size());
+	codes.value.reserve(codes.size() + contours.size());
+	codes.isClosed.reserve(codes.size() + contours.size());
+	codes.boundingRect.reserve(codes.size() + contours.size());
 
-	for (int k = 0; k < contours.size(); ++k)
+	for (size_t i = 0; i < contours.size(); ++i)
 	{
-		Contour& c = contours[k];
-		std::set<int> outers_left;
-		std::set<int> outers_right;
+		codes.add(contours.contourPoints(i), contours.value[i], contours.isClosed[i] != 0);
+	}
+}
 
-		int y = c.points[0].y;
-		uchar prev = 0;
-		for (int x = 0; x < width; ++x)
-		{
-			uchar val = img.at<uchar>(y, x);
+void ContoursOperations::findDepth(const cv::Mat& labels, ContourSet& contours, RegionMap* regionMap)
+{
+	const int width = labels.cols;
+	const int height = labels.rows;
+	if (labels.empty())
+	{
+		return;
+	}
 
-			if (val == prev)
+	// one raster pass: 4-connected background regions by union-find, and which regions each contour touches
+	cv::Mat regions(labels.size(), CV_32SC1); // provisional region per background pixel, -1 on contours
+	std::vector<int> unionParent;
+	auto find = [&](int r)
+		{
+			while (unionParent[r] != r)
 			{
-				continue;
+				unionParent[r] = unionParent[unionParent[r]];
+				r = unionParent[r];
+			}
+			return r;
+		};
+	std::vector<std::uint64_t> touches; // contour << 32 | region
+	std::vector<int> lastRegion(contours.size(), -1);
+	auto touch = [&](int id, int region)
+		{
+			if (lastRegion[id - 1] != region)
+			{
+				lastRegion[id - 1] = region;
+				touches.push_back(static_cast<std::uint64_t>(id - 1) << 32 | static_cast<std::uint32_t>(region));
 			}
+		};
 
-			if (val != 0 && val != c.value)
+	for (int y = 0; y < height; ++y)
+	{
+		const int* idRow = labels.ptr<int>(y);
+		const int* idPrev = y > 0 ? labels.ptr<int>(y - 1) : nullptr;
+		int* regionRow = regions.ptr<int>(y);
+		const int* regionPrev = y > 0 ? regions.ptr<int>(y - 1) : nullptr;
+		for (int x = 0; x < width; ++x)
+		{
+			const int left = x > 0 ? idRow[x - 1] : -1;
+			const int up = y > 0 ? idPrev[x] : -1;
+			if (idRow[x] == 0)
 			{
-				if (x < c.points[0].x)
+				int r;
+				if (left == 0)
 				{
-					if (outers_left.find(val) == outers_left.end())
-					{
-						outers_left.insert(val);
-					}
-					else
+					r = regionRow[x - 1];
+					if (up == 0)
 					{
-						outers_left.erase(val);
+						const int a = find(r);
+						const int b = find(regionPrev[x]);
+						if (a != b)
+						{
+							unionParent[std::max(a, b)] = std::min(a, b);
+						}
 					}
 				}
+				else if (up == 0)
+				{
+					r = regionPrev[x];
+				}
 				else
 				{
-					if (outers_right.find(val) == outers_right.end())
-					{
-						outers_right.insert(val);
-					}
-					else
-					{
-						outers_right.erase(val);
-					}
+					r = static_cast<int>(unionParent.size());
+					unionParent.push_back(r);
+				}
+				regionRow[x] = r;
+
+				if (left > 0)
+				{
+					touch(left, r);
+				}
+				if (up > 0)
+				{
+					touch(up, r);
+				}
+			}
+			else
+			{
+				regionRow[x] = -1;
+				if (left == 0)
+				{
+					touch(idRow[x], regionRow[x - 1]);
+				}
+				if (up == 0)
+				{
+					touch(idRow[x], regionPrev[x]);
 				}
-				prev = val;
 			}
+		}
+	}
+
+	// region <-> contour adjacency between resolved regions
+	for (auto& t : touches)
+	{
+		t = (t & 0xFFFFFFFF00000000ull) | static_cast<std::uint32_t>(find(static_cast<int>(t & 0xFFFFFFFFu)));
+	}
+	std::sort(touches.begin(), touches.end());
+	touches.erase(std::unique(touches.begin(), touches.end()), touches.end());
+
+	const size_t regionCount = unionParent.size();
+	std::vector<int> contourFirst(contours.size() + 1, 0);
+	std::vector<int> regionFirst(regionCount + 1, 0);
+	for (std::uint64_t t : touches)
+	{
+		++contourFirst[(t >> 32) + 1];
+		++regionFirst[(t & 0xFFFFFFFFu) + 1];
+	}
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		contourFirst[i + 1] += contourFirst[i];
+	}
+	for (size_t r = 0; r < regionCount; ++r)
+	{
+		regionFirst[r + 1] += regionFirst[r];
+	}
+	std::vector<int> contourRegions(touches.size());
+	std::vector<int> regionContours(touches.size());
+	{
+		std::vector<int> fill(regionFirst.begin(), regionFirst.end() - 1);
+		for (size_t k = 0; k < touches.size(); ++k)
+		{
+			const int c = static_cast<int>(touches[k] >> 32);
+			const int r = static_cast<int>(touches[k] & 0xFFFFFFFFu);
+			contourRegions[k] = r; // touches are sorted by contour
+			regionContours[fill[r]++] = c;
+		}
+	}
 
-			std::set<int> outers;
-			std::set_union(outers_left.begin(), outers_left.end(), outers_right.begin(), outers_right.end(), std::inserter(outers, outers.begin()));
+	// breadth-first from the outer region, the one with the most border pixels: a region's level is
+	// the number of contours crossed to reach it, a contour's depth the level of the region outside it;
+	// open contours cut the frame too, so hills cut by the border still nest like closed ones
+	std::vector<int> borderPixels(regionCount, 0);
+	auto countBorder = [&](int r)
+		{
+			if (r >= 0)
+			{
+				++borderPixels[find(r)];
+			}
+		};
+	for (int x = 0; x < width; ++x)
+	{
+		countBorder(regions.at<int>(0, x));
+		countBorder(regions.at<int>(height - 1, x));
+	}
+	for (int y = 0; y < height; ++y)
+	{
+		countBorder(regions.at<int>(y, 0));
+		countBorder(regions.at<int>(y, width - 1));
+	}
+	// roots by border length, so regions the outer one cannot reach (cut off by touching contours) still get levels
+	std::vector<int> roots;
+	for (size_t r = 0; r < regionCount; ++r)
+	{
+		if (unionParent[r] == static_cast<int>(r))
+		{
+			roots.push_back(static_cast<int>(r));
+		}
+	}
+	std::stable_sort(roots.begin(), roots.end(), [&](int a, int b) { return borderPixels[a] > borderPixels[b]; });
 
-			for (auto iter = outers.begin(); iter != outers.end();)
+	std::vector<int> level(regionCount, -1);
+	std::vector<int> entry(regionCount, -1); // contour crossed to enter a region
+	std::vector<int> queue;
+	queue.reserve(roots.size());
+	std::fill(contours.depth.begin(), contours.depth.end(), 0);
+	std::fill(contours.parent.begin(), contours.parent.end(), -1);
+	std::vector<char> crossed(contours.size(), 0);
+	for (int root : roots)
+	{
+		if (level[root] >= 0)
+		{
+			continue;
+		}
+		level[root] = 0;
+		queue.push_back(root);
+		for (size_t head = queue.size() - 1; head < queue.size(); ++head)
+		{
+			const int r = queue[head];
+			for (int k = regionFirst[r]; k < regionFirst[r + 1]; ++k)
 			{
-				int id = *iter;
-				Contour& outer = contours[id - 1];
-				if ((outer.boundingRect & c.boundingRect) != c.boundingRect)
+				const int c = regionContours[k];
+				if (crossed[c])
 				{
-					iter = outers.erase(iter);
+					continue;
 				}
-				else
+				crossed[c] = 1;
+				contours.depth[c] = level[r];
+				contours.parent[c] = entry[r];
+				for (int j = contourFirst[c]; j < contourFirst[c + 1]; ++j)
 				{
-					++iter;
+					const int next = contourRegions[j];
+					if (level[next] < 0)
+					{
+						level[next] = level[r] + 1;
+						entry[next] = c;
+						queue.push_back(next);
+					}
 				}
 			}
+		}
+	}
+
+	// children in index order
+	std::fill(contours.firstChild.begin(), contours.firstChild.end(), -1);
+	std::fill(contours.nextSibling.begin(), contours.nextSibling.end(), -1);
+	for (int c = static_cast<int>(contours.size()) - 1; c >= 0; --c)
+	{
+		const int p = contours.parent[c];
+		if (p >= 0)
+		{
+			contours.nextSibling[c] = contours.firstChild[p];
+			contours.firstChild[p] = c;
+		}
+	}
 
-			c.depth = outers.size();
+	if (regionMap)
+	{
+		regionMap->labels = regions;
+		regionMap->level.resize(regionCount);
+		for (size_t r = 0; r < regionCount; ++r)
+		{
+			regionMap->level[r] = level[find(static_cast<int>(r))];
 		}
 	}
 }
@@ -316,15 +1328,31 @@ cv::Scalar getRandomBrightColor(float minLum = 80.0f)
 	}
 }
 
-void ContoursOperations::fillContours(cv::Mat& contoursMat, const std::vector<Contour>& contours, cv::Mat& drawing, FillMode fillMode)
+// Colour of every region from the colour of its nesting level, channels bytes per region
+static std::vector<uchar> regionColors(const RegionMap& regions, const std::vector<cv::Scalar>& levelColors, int channels)
+{
+	const int maxLevel = static_cast<int>(levelColors.size()) - 1;
+	std::vector<uchar> colors(regions.level.size() * channels);
+	for (size_t r = 0; r < regions.level.size(); ++r)
+	{
+		const cv::Scalar& color = levelColors[std::min(std::max(regions.level[r], 0), maxLevel)];
+		for (int c = 0; c < channels; ++c)
+		{
+			colors[r * channels + c] = cv::saturate_cast<uchar>(color[c]);
+		}
+	}
+	return colors;
+}
+
+void ContoursOperations::fillContours(const RegionMap& regions, const ContourSet& contours, cv::Mat& drawing, FillMode fillMode)
 {
 	int max_depth = 0;
 
-	for (auto& c : contours)
+	for (int depth : contours.depth)
 	{
-		if (c.depth > max_depth)
+		if (depth > max_depth)
 		{
-			max_depth = c.depth;
+			max_depth = depth;
 		}
 	}
 
@@ -345,59 +1373,356 @@ void ContoursOperations::fillContours(cv::Mat& contoursMat, const std::vector<Co
 		scaler.init(-1, max_depth, cv::Scalar(18, 185, 27), cv::Scalar(20, 20, 185));
 	}
 
-	int width = contoursMat.cols;
-	int height = contoursMat.rows;
+	// a region at level L lies inside a contour of depth L - 1 and takes its colour, the outer
+	// regions (level 0) the colour of the holes
+	std::vector<cv::Scalar> levelColors(max_depth + 2);
+	for (int l = 0; l <= max_depth + 1; ++l)
+	{
+		const cv::Scalar color = scaler.getColor(l - 1);
+		levelColors[l] = cv::Scalar(color[0], color[1], color[2], 255);
+	}
 
-	for (int k = 0; k < contours.size(); ++k)
+	// one pass over the frame, contour pixels keep their colour
+	const ImageKernels::Table& kernels = ImageKernels::kernels();
+	const std::vector<uchar> colors = regionColors(regions, levelColors, drawing.channels());
+	if (drawing.channels() == 4)
+	{
+		// BGRA pixels as the 32-bit words of an RGB32 QImage
+		std::vector<std::uint32_t> words(regions.level.size());
+		std::memcpy(words.data(), colors.data(), colors.size());
+#pragma omp parallel for
+		for (int y = 0; y < drawing.rows; ++y)
+		{
+			kernels.fillRegionsRow4(regions.labels.ptr<int>(y), words.data(), drawing.ptr<std::uint32_t>(y), drawing.cols);
+		}
+	}
+	else
 	{
-		const Contour& c = contours[k];
-		cv::Point seed_point(-1, -1);
+#pragma omp parallel for
+		for (int y = 0; y < drawing.rows; ++y)
+		{
+			kernels.fillRegionsRow3(regions.labels.ptr<int>(y), colors.data(), drawing.ptr<uchar>(y), drawing.cols);
+		}
+	}
+}
+
+template <class Pixel>
+static void inpaintContoursImpl(cv::Mat& drawing, const cv::Mat& labels)
+{
+	const int width = drawing.cols;
+	const int height = drawing.rows;
 
-		// try point polygon test to find seed point
-		for (auto& pt : c.points)
+	// chamfer distance (3 straight, 4 diagonal) to the nearest non-contour pixel, whose colour is
+	// carried along; a forward and a backward raster sweep settle every pixel
+	const ushort far = std::numeric_limits<ushort>::max();
+	cv::Mat dist(drawing.size(), CV_16UC1);
+	auto relax = [&](ushort* d, Pixel* px, int x, int y, int nx, int ny, int cost)
 		{
-			for (int m = -1; m <= 1; ++m)
+			if (static_cast<unsigned int>(nx) < static_cast<unsigned int>(width) && static_cast<unsigned int>(ny) < static_cast<unsigned int>(height))
 			{
-				for (int n = -1; n <= 1; ++n)
+				const int nd = dist.at<ushort>(ny, nx) + cost;
+				if (nd < d[x])
 				{
-					if (m == 0 && n == 0)
-					{
-						continue;
-					}
-					cv::Point p(pt.x + m, pt.y + n);
-					if (p.x < 0 || p.x >= width || p.y < 0 || p.y >= height)
-					{
-						continue;
-					}
-					if (contoursMat.at<uchar>(p) == 0)
-					{
-						if (cv::pointPolygonTest(c.points, p, false) > 0)
-						{
-							seed_point = p;
-							goto floodfill;
-						}
-					}
+					d[x] = static_cast<ushort>(std::min<int>(nd, far));
+					px[x] = drawing.at<Pixel>(ny, nx);
 				}
 			}
+		};
+
+	for (int y = 0; y < height; ++y)
+	{
+		const int* labelRow = labels.ptr<int>(y);
+		ushort* d = dist.ptr<ushort>(y);
+		Pixel* px = drawing.ptr<Pixel>(y);
+		for (int x = 0; x < width; ++x)
+		{
+			if (labelRow[x] == 0)
+			{
+				d[x] = 0;
+				continue;
+			}
+			d[x] = far;
+			relax(d, px, x, y, x - 1, y, 3);
+			relax(d, px, x, y, x, y - 1, 3);
+			relax(d, px, x, y, x - 1, y - 1, 4);
+			relax(d, px, x, y, x + 1, y - 1, 4);
+		}
+	}
+	for (int y = height - 1; y >= 0; --y)
+	{
+		const int* labelRow = labels.ptr<int>(y);
+		ushort* d = dist.ptr<ushort>(y);
+		Pixel* px = drawing.ptr<Pixel>(y);
+		for (int x = width - 1; x >= 0; --x)
+		{
+			if (labelRow[x] == 0 || d[x] <= 3)
+			{
+				continue;
+			}
+			relax(d, px, x, y, x + 1, y, 3);
+			relax(d, px, x, y, x, y + 1, 3);
+			relax(d, px, x, y, x + 1, y + 1, 4);
+			relax(d, px, x, y, x - 1, y + 1, 4);
+		}
+	}
+}
+
+void ContoursOperations::inpaintContours(cv::Mat& drawing, const cv::Mat& labels)
+{
+	if (drawing.channels() == 4)
+	{
+		inpaintContoursImpl<cv::Vec4b>(drawing, labels);
+	}
+	else
+	{
+		inpaintContoursImpl<cv::Vec3b>(drawing, labels);
+	}
+}
+
+void ContourSet::clear()
+{
+	points.clear();
+	offsets.assign(1, 0);
+	vertices.clear();
+	vertexOffsets.assign(1, 0);
+	value.clear();
+	depth.clear();
+	isClosed.clear();
+	boundingRect.clear();
+	level.clear();
+	parent.clear();
+	firstChild.clear();
+	nextSibling.clear();
+}
+
+void ContourSet::reserve(size_t contours, size_t pointCount)
+{
+	points.reserve(pointCount);
+	offsets.reserve(contours + 1);
+	vertexOffsets.reserve(contours + 1);
+	value.reserve(contours);
+	depth.reserve(contours);
+	isClosed.reserve(contours);
+	boundingRect.reserve(contours);
+	level.reserve(contours);
+	parent.reserve(contours);
+	firstChild.reserve(contours);
+	nextSibling.reserve(contours);
+}
+
+void ContourSet::addContour(bool closed, double contourLevel)
+{
+	const size_t first = offsets.back();
+	const int count = static_cast<int>(points.size() - first);
+
+	value.push_back(static_cast<double>(value.size() + 1));
+	depth.push_back(0);
+	isClosed.push_back(closed);
+	boundingRect.push_back(count > 0 ? cv::boundingRect(cv::Mat(count, 1, CV_32SC2, points.data() + first)) : cv::Rect());
+	level.push_back(contourLevel);
+	parent.push_back(-1);
+	firstChild.push_back(-1);
+	nextSibling.push_back(-1);
+	offsets.push_back(points.size());
+	vertexOffsets.push_back(vertices.size());
+}
+
+void ChainCodeSet::clear()
+{
+	start.clear();
+	runCount.clear();
+	wordOffsets.assign(1, 0);
+	runOffsets.assign(1, 0);
+	count.clear();
+	words.clear();
+	value.clear();
+	isClosed.clear();
+	boundingRect.clear();
+}
+
+void ChainCodeSet::add(Span<cv::Point> points, double contourValue, bool closed)
+{
+	std::uint64_t bits = 0;
+	int shift = 0;
+	auto flush = [&]()
+		{
+			if (shift != 0)
+			{
+				words.push_back(bits);
+				bits = 0;
+				shift = 0;
+			}
+			wordOffsets.push_back(words.size());
+		};
+
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		const int dx = i > 0 ? points[i].x - points[i - 1].x : 0;
+		const int dy = i > 0 ? points[i].y - points[i - 1].y : 0;
+		if (i == 0 || std::abs(dx) > 1 || std::abs(dy) > 1 || (dx == 0 && dy == 0))
+		{
+			// not a step to an 8-neighbour: the point starts a new run
+			if (i > 0)
+			{
+				flush();
+			}
+			start.push_back(points[i]);
+			runCount.push_back(1);
+			continue;
+		}
+
+		bits |= static_cast<std::uint64_t>(stepDirection[(dy + 1) * 3 + (dx + 1)]) << shift;
+		shift += 3;
+		if (shift == 3 * ChainCode::stepsPerWord)
+		{
+			words.push_back(bits);
+			bits = 0;
+			shift = 0;
+		}
+		++runCount.back();
+	}
+	if (!points.empty())
+	{
+		flush();
+	}
+
+	runOffsets.push_back(start.size());
+	count.push_back(points.size());
+	value.push_back(contourValue);
+	isClosed.push_back(closed);
+	boundingRect.push_back(points.empty() ? cv::Rect() : cv::boundingRect(cv::Mat(static_cast<int>(points.size()), 1, CV_32SC2, const_cast<cv::Point*>(points.data()))));
+}
+
+Contour ContourSet::operator[](size_t i) const
+{
+	Contour c;
+	c.index = static_cast<int>(i);
+	c.value = value[i];
+	c.isClosed = isClosed[i] != 0;
+	c.depth = depth[i];
+	c.parent = parent[i];
+	c.points = contourPoints(i);
+	c.boundingRect = boundingRect[i];
+	c.level = level[i];
+	c.vertices = contourVertices(i);
+	return c;
+}
+
+// Position of (x, y) on the Hilbert curve filling a 65536 x 65536 grid
+static std::uint32_t hilbertIndex(std::uint32_t x, std::uint32_t y)
+{
+	std::uint32_t d = 0;
+	for (std::uint32_t s = 1u << 15; s > 0; s >>= 1)
+	{
+		const std::uint32_t rx = (x & s) ? 1 : 0;
+		const std::uint32_t ry = (y & s) ? 1 : 0;
+		d += s * s * ((3 * rx) ^ ry);
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
 		}
+	}
+	return d;
+}
+
+void ContourIndex::build(const std::vector<cv::Rect>& boxes)
+{
+	m_count = boxes.size();
+	m_boxes.clear();
+	m_ids.clear();
+	m_levelEnd.clear();
+	if (m_count == 0)
+	{
+		return;
+	}
+
+	// leaves sorted along the Hilbert curve through the box centres, so consecutive runs are compact
+	cv::Rect extent = boxes[0];
+	for (const cv::Rect& r : boxes)
+	{
+		extent |= r;
+	}
+	const double scaleX = 65535.0 / std::max(1, 2 * extent.width);
+	const double scaleY = 65535.0 / std::max(1, 2 * extent.height);
+	std::vector<std::pair<std::uint32_t, int>> order(m_count);
+	for (size_t i = 0; i < m_count; ++i)
+	{
+		const cv::Rect& r = boxes[i];
+		const std::uint32_t x = static_cast<std::uint32_t>((2 * (r.x - extent.x) + r.width) * scaleX);
+		const std::uint32_t y = static_cast<std::uint32_t>((2 * (r.y - extent.y) + r.height) * scaleY);
+		order[i] = { hilbertIndex(x, y), static_cast<int>(i) };
+	}
+	std::sort(order.begin(), order.end());
+
+	m_boxes.reserve(m_count + m_count / (m_nodeSize - 1) + 1);
+	m_ids.reserve(m_boxes.capacity());
+	for (const auto& o : order)
+	{
+		m_boxes.push_back(boxes[o.second]);
+		m_ids.push_back(o.second);
+	}
+	m_levelEnd.push_back(m_count);
 
-	floodfill:
-		if (seed_point.x != -1)
+	// pack each level into nodes of m_nodeSize consecutive entries until one root is left
+	size_t first = 0;
+	do
+	{
+		const size_t end = m_levelEnd.back();
+		for (size_t i = first; i < end; i += m_nodeSize)
 		{
-			cv::Scalar color = scaler.getColor(c.depth);
-			cv::floodFill(drawing, seed_point, color);
+			cv::Rect box = m_boxes[i];
+			for (size_t j = i + 1; j < std::min(end, i + m_nodeSize); ++j)
+			{
+				box |= m_boxes[j];
+			}
+			m_boxes.push_back(box);
+			m_ids.push_back(static_cast<int>(i));
 		}
+		first = end;
+		m_levelEnd.push_back(m_boxes.size());
+	} while (m_levelEnd.back() - first > 1);
+}
+
+void ContourIndex::query(const cv::Rect& rect, std::vector<int>& result) const
+{
+	if (m_boxes.empty())
+	{
+		return;
 	}
 
-	// fill the holes
-	cv::Scalar hole_color = scaler.getColor(-1);
-	for (int i = 0; i < drawing.rows; ++i)
+	// (node position, level of its children)
+	std::vector<std::pair<size_t, size_t>> stack;
+	stack.emplace_back(m_boxes.size() - 1, m_levelEnd.size() - 2);
+	while (!stack.empty())
 	{
-		for (int j = 0; j < drawing.cols; ++j)
+		const size_t node = stack.back().first;
+		const size_t level = stack.back().second;
+		stack.pop_back();
+		if ((m_boxes[node] & rect).empty())
 		{
-			if (drawing.at<cv::Vec3b>(i, j) == cv::Vec3b(0, 0, 0))
+			continue;
+		}
+
+		const size_t first = m_ids[node];
+		const size_t end = std::min(first + m_nodeSize, m_levelEnd[level]);
+		for (size_t i = first; i < end; ++i)
+		{
+			if ((m_boxes[i] & rect).empty())
+			{
+				continue;
+			}
+			if (level == 0)
+			{
+				result.push_back(m_ids[i]);
+			}
+			else
 			{
-				cv::floodFill(drawing, cv::Point(j, i), hole_color);
+				stack.emplace_back(i, level - 1);
 			}
 		}
 	}
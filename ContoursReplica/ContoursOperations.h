@@ -1,14 +1,88 @@
 #pragma once
 #include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <iterator>
 
+// Read-only view of count contiguous elements
+template <class T>
+struct Span
+{
+    const T* ptr = nullptr;
+    size_t count = 0;
+
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T& front() const { return ptr[0]; }
+    const T& back() const { return ptr[count - 1]; }
+};
+
+// One contour of a ContourSet; points and vertices view the set's buffers and stay valid
+// until contours are added to or removed from the set
 struct Contour
 {
     int index;
     double value;
     bool isClosed;
     int depth;
-    std::vector<cv::Point> points;
+    int parent;
+    Span<cv::Point> points;
     cv::Rect boundingRect;
+    double level; // isoline level of noise * mul (marching squares only)
+    Span<cv::Point2f> vertices; // subpixel polyline (marching squares only)
+};
+
+// All contours of an image: the points of every contour back to back in one buffer
+// addressed by offsets, the per-contour metadata in parallel arrays
+struct ContourSet
+{
+    std::vector<cv::Point> points; // points of all contours
+    std::vector<size_t> offsets{ 0 }; // contour i owns points[offsets[i], offsets[i + 1])
+    std::vector<cv::Point2f> vertices; // subpixel vertices of all contours (marching squares only)
+    std::vector<size_t> vertexOffsets{ 0 }; // contour i owns vertices[vertexOffsets[i], vertexOffsets[i + 1])
+    std::vector<double> value;
+    std::vector<int> depth;
+    std::vector<uchar> isClosed;
+    std::vector<cv::Rect> boundingRect;
+    std::vector<double> level;
+    // containment hierarchy filled by ContoursOperations::findDepth, -1 = none
+    std::vector<int> parent;
+    std::vector<int> firstChild;
+    std::vector<int> nextSibling;
+
+    size_t size() const { return value.size(); }
+    bool empty() const { return value.empty(); }
+    void clear();
+    void reserve(size_t contours, size_t points);
+    // Closes the points and vertices appended since the previous contour into a new one
+    // with value index + 1, depth 0 and the bounding box of its points
+    void addContour(bool closed, double contourLevel = 0.0);
+    Span<cv::Point> contourPoints(size_t i) const { return { points.data() + offsets[i], offsets[i + 1] - offsets[i] }; }
+    Span<cv::Point2f> contourVertices(size_t i) const { return { vertices.data() + vertexOffsets[i], vertexOffsets[i + 1] - vertexOffsets[i] }; }
+    Contour operator[](size_t i) const;
+};
+
+// Static packed R-tree over the bounding boxes of a ContourSet or ChainCodeSet (Hilbert sorted, 16 entries per node)
+class ContourIndex
+{
+public:
+    ContourIndex() {}
+    explicit ContourIndex(const ContourSet& contours) { build(contours.boundingRect); }
+    explicit ContourIndex(const std::vector<cv::Rect>& boxes) { build(boxes); }
+    void build(const ContourSet& contours) { build(contours.boundingRect); }
+    // boxes[i] is the bounding box of contour i
+    void build(const std::vector<cv::Rect>& boxes);
+    // Appends the indices of the contours whose bounding box intersects rect
+    void query(const cv::Rect& rect, std::vector<int>& result) const;
+protected:
+    static constexpr int m_nodeSize = 16;
+    size_t m_count = 0; // number of contours, the leaves come first in m_boxes
+    std::vector<cv::Rect> m_boxes; // leaves, then each level of nodes up to the root
+    std::vector<int> m_ids; // contour index for leaves, position of the first child for nodes
+    std::vector<size_t> m_levelEnd; // end of each level in m_boxes
 };
 
 class ColorScaler
@@ -38,6 +112,114 @@ enum class Direction
     NONE
 };
 
+// Freeman chain code of one contour: runs of 8-connected points, each stored as its start point plus
+// one 3-bit Direction per step, 21 steps to a 64-bit word, lowest bits first. A step to a point that is
+// not an 8-neighbour starts a new run. Views the buffers of a ChainCodeSet
+struct ChainCode
+{
+    static constexpr int stepsPerWord = 21;
+    static constexpr int stepX[8] = { 0, 1, 1, 1, 0, -1, -1, -1 }; // indexed by Direction
+    static constexpr int stepY[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+
+    // Decodes the points one step at a time, start point of the first run first
+    class Iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = cv::Point;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const cv::Point*;
+        using reference = const cv::Point&;
+
+        Iterator(const ChainCode& code, size_t i)
+            : m_pt(code.runs ? code.start[0] : cv::Point()), m_i(i), m_count(code.count), m_start(code.start), m_runCount(code.runCount),
+            m_words(code.words), m_bits(0), m_left(0), m_runLeft(code.runs ? code.runCount[0] - 1 : 0) {}
+        const cv::Point& operator*() const { return m_pt; }
+        const cv::Point* operator->() const { return &m_pt; }
+        Iterator& operator++()
+        {
+            if (++m_i < m_count)
+            {
+                if (m_runLeft == 0)
+                {
+                    // next run, its steps start on a new word
+                    m_pt = *++m_start;
+                    m_runLeft = *++m_runCount - 1;
+                    m_left = 0;
+                    return *this;
+                }
+                if (m_left == 0)
+                {
+                    m_bits = *m_words++;
+                    m_left = stepsPerWord;
+                }
+                const int direction = static_cast<int>(m_bits & 7);
+                m_bits >>= 3;
+                --m_left;
+                --m_runLeft;
+                m_pt.x += stepX[direction];
+                m_pt.y += stepY[direction];
+            }
+            return *this;
+        }
+        Iterator operator++(int) { Iterator it = *this; ++*this; return it; }
+        bool operator==(const Iterator& other) const { return m_i == other.m_i; }
+        bool operator!=(const Iterator& other) const { return m_i != other.m_i; }
+    private:
+        cv::Point m_pt;
+        size_t m_i;
+        size_t m_count;
+        const cv::Point* m_start;
+        const size_t* m_runCount;
+        const std::uint64_t* m_words;
+        std::uint64_t m_bits;
+        int m_left; // steps left in m_bits
+        size_t m_runLeft; // steps left in the current run
+    };
+
+    const cv::Point* start = nullptr; // first point of every run
+    const size_t* runCount = nullptr; // points of every run
+    size_t runs = 0;
+    size_t count = 0; // number of points
+    const std::uint64_t* words = nullptr; // steps of all runs, every run starts on a new word
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    Iterator begin() const { return Iterator(*this, 0); }
+    Iterator end() const { return Iterator(*this, count); }
+};
+
+// Chain codes of many contours, all runs and words in one buffer each; about 20 times smaller than the
+// points of a ContourSet
+struct ChainCodeSet
+{
+    std::vector<cv::Point> start; // per run
+    std::vector<size_t> runCount; // per run
+    std::vector<size_t> wordOffsets{ 0 }; // run r owns words[wordOffsets[r], wordOffsets[r + 1])
+    std::vector<size_t> runOffsets{ 0 }; // contour i owns runs [runOffsets[i], runOffsets[i + 1])
+    std::vector<size_t> count; // points per contour
+    std::vector<std::uint64_t> words;
+    std::vector<double> value; // per contour, as in the ContourSet
+    std::vector<uchar> isClosed;
+    std::vector<cv::Rect> boundingRect; // per contour, of its points
+
+    size_t size() const { return count.size(); }
+    bool empty() const { return count.empty(); }
+    void clear();
+    // Appends the chain code of points as a new contour
+    void add(Span<cv::Point> points, double contourValue, bool closed);
+    // Direction of step k of run r
+    Direction step(size_t r, size_t k) const
+    {
+        return static_cast<Direction>((words[wordOffsets[r] + k / ChainCode::stepsPerWord] >> (3 * (k % ChainCode::stepsPerWord))) & 7);
+    }
+    ChainCode operator[](size_t i) const
+    {
+        const size_t r = runOffsets[i];
+        return { start.data() + r, runCount.data() + r, runOffsets[i + 1] - r, count[i], words.data() + wordOffsets[r] };
+    }
+};
+
 enum class GenerationMode
 {
     legacy,
@@ -50,12 +232,37 @@ enum class FillMode
     random
 };
 
+enum class NoiseBackend
+{
+    perlin,
+    openSimplex2S
+};
+
+struct FractalParams
+{
+    int octaves = 5; // number of noise layers
+    float persistence = 0.6f; // amplitude multiplier between octaves
+    float lacunarity = 2.0f; // frequency multiplier between octaves
+    float scale = 80.0f; // size of the base octave features in pixels
+};
+
+struct TileParams
+{
+    unsigned int seed = 0; // noise seed shared by every tile of the map
+    int x = 0, y = 0; // tile origin in global map pixels
+    int periodX = 256, periodY = 256; // Perlin noise period in lattice cells (clamped to 1..256), 256 = no extra wrapping
+};
+
 struct GenerationParams
 {
     int width, height; // image size
     int dpi; // render dpi
     double Xmul, Ymul; // multipliers for X and Y for Perlin noise
     int mul; // general multiplier for Perlin noise
+    NoiseBackend noise; // noise generator behind the isolines
+    double noiseTolerance; // max noise error in isoline levels for coarse evaluation, 0 = exact
+    bool analyticGradient; // rasterize isolines from analytic noise gradients instead of Sobel
+    bool marchingSquares; // extract subpixel contours from the noise field instead of thinning and tracing
     bool generateWells; // generate wells
     int numOfWells; // number of wells
     bool generateIsolines; // generate isolines
@@ -66,20 +273,68 @@ struct GenerationParams
     bool drawValues; // draw values on isolines
     bool saveValuesToFile; // save contour values to separate files
     bool saveBoundingBoxesToFile; // save contour values' bounding boxes to file
+    bool saveContoursToFile; // save contours as chain codes to file
     int textDistance; // minimal distance between texts on isolines
     int textSize; // font size
     GenerationMode mode;
+    FractalParams fractal; // height field parameters for python mode
+};
+
+// Connected background regions between the contours, from ContoursOperations::findDepth
+struct RegionMap
+{
+    cv::Mat labels; // CV_32SC1 region id per background pixel, -1 on contour pixels
+    std::vector<int> level; // per region id: contours crossed to reach it from the outer region
+};
+
+// Coarse noise evaluation chosen from GenerationParams::noiseTolerance
+struct NoiseSampling
+{
+    int step; // pixels between exact noise samples, 1 = every pixel is exact
+    double errorBound; // upper bound of |coarse - exact| of noise * mul, in isoline levels
 };
 
 namespace ContoursOperations
 {
-    cv::Mat generateIsolines(const GenerationParams& params);
-    void findContours(const cv::Mat& img, std::vector<Contour>& contours);
+    // Float selects the noise field precision (float and double are instantiated)
+    // With params.analyticGradient, gradient receives the CV_32FC2 per-pixel gradient of noise * mul
+    template <class Float = float>
+    cv::Mat generateIsolines(const GenerationParams& params, cv::Mat* gradient = nullptr);
+    // Isolines of one tile of a virtual map; tiles with the same seed and period stitch seamlessly
+    template <class Float = float>
+    cv::Mat generateIsolines(const GenerationParams& params, const TileParams& tile, cv::Mat* gradient = nullptr);
+    // Continuous noise * mul field (CV_32FC1 or CV_64FC1), isolines are its integer levels
+    template <class Float = float>
+    cv::Mat generateNoiseField(const GenerationParams& params);
+    template <class Float = float>
+    cv::Mat generateNoiseField(const GenerationParams& params, const TileParams& tile);
+    // Lattice step and error bound of the noise sampling; depends on params only, so tiles share the lattice
+    NoiseSampling noiseSampling(const GenerationParams& params);
+    // Marching squares at every integer level of field; appends contours with subpixel vertices
+    void marchingSquares(const cv::Mat& field, ContourSet& contours, cv::Mat* labels = nullptr);
+    // Fractal (fBm) Perlin height field normalized to [0, 1], CV_32FC1 of size height x width
+    cv::Mat generateHeightField(int width, int height, const FractalParams& fractal);
+    // Guo-Hall thinning of a binary CV_8UC1 mask (foreground >= 128) to a 0/255 skeleton,
+    // identical to cv::ximgproc::thinning(THINNING_GUOHALL) but bit-packed, row bands run on OpenMP threads
+    void thinning(const cv::Mat& src, cv::Mat& dst);
+    // labels (optional) receives the CV_32SC1 label plane: contour index + 1 on contour pixels, 0 elsewhere
+    void findContours(const cv::Mat& img, ContourSet& contours, cv::Mat* labels = nullptr);
+    // Traces bands of tileRows (> 0) rows concurrently; the components of pixels crossing a band border
+    // are traced again serially, so the output is identical to findContours for any tileRows and thread count
+    void findContoursParallel(const cv::Mat& img, ContourSet& contours, cv::Mat* labels = nullptr, int tileRows = 256);
+    // Appends the points of the contour through (x_start, y_start) to contour, erasing them from img
     void extractContour(int x_start, int y_start, cv::Mat& img, std::vector<cv::Point>& contour);
     Direction getDirection(cv::Point prev, cv::Point next);
     std::vector<cv::Point> getOrder(cv::Point pt, Direction direction);
-    // Find depth of each contour
-    void findDepth(cv::Mat& img, std::vector<Contour>& contours);
-    void fillContours(cv::Mat& contoursMat, const std::vector<Contour>& contours, cv::Mat& drawing, FillMode fillMode);
+    // Chain codes of every contour of contours, appended to codes
+    void encodeChainCodes(const ContourSet& contours, ChainCodeSet& codes);
+    // Find depth of each contour: the number of contours crossed on the way in from the outer region,
+    // computed in one pass over the label plane of the tracer; also fills the containment hierarchy
+    void findDepth(const cv::Mat& labels, ContourSet& contours, RegionMap* regions = nullptr);
+    // Colours every region of drawing (CV_8UC3, or CV_8UC4 BGRA such as an RGB32 QImage) by its nesting level in one pass
+    void fillContours(const RegionMap& regions, const ContourSet& contours, cv::Mat& drawing, FillMode fillMode);
+    // Gives every contour pixel (labels != 0) of drawing (CV_8UC3 or CV_8UC4) the colour of the nearest non-contour pixel,
+    // a linear time replacement for inpainting the traced lines
+    void inpaintContours(cv::Mat& drawing, const cv::Mat& labels);
 };
 
@@ -3,10 +3,16 @@
 #include <qpainter.h>
 #include "ContoursOperations.h"
 #include <qpainterpath.h>
+#include <qfontmetrics.h>
 #include <qdir.h>
 #include <quuid.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
 
-void DrawOperations::drawRandomWell(QPixmap& image, const WellParams& params)
+void DrawOperations::drawRandomWell(QImage& image, const WellParams& params)
 {
 	int width = image.width();
 	int height = image.height();
@@ -56,7 +62,52 @@ void DrawOperations::drawWellTitle(QPainter& painter, const QPoint& wellPt, cons
 	painter.drawText(textPt, idWellStr);
 }
 
-void DrawOperations::drawContourValues(QPainter& painter, const Contour& contour, float width, QColor textColor, const QFont& font, int minTextDistance, bool saveToFile, bool saveBBtoFile, std::vector<BoundingBox>& bbox)
+// arcLength[i] is the length of the pixel chain up to point i, with one extra entry closing a closed contour
+static void cumulativeLength(const Contour& contour, std::vector<double>& arcLength)
+{
+	const size_t n = contour.points.size();
+	arcLength.assign(1, 0.0);
+	arcLength.reserve(n + 1);
+	for (size_t i = 1; i < n; ++i)
+	{
+		arcLength.push_back(arcLength.back() + cv::norm(contour.points[i] - contour.points[i - 1]));
+	}
+	if (contour.isClosed && n > 1)
+	{
+		arcLength.push_back(arcLength.back() + cv::norm(contour.points.front() - contour.points.back()));
+	}
+}
+
+// Point at arc length s, wrapping around closed contours and clamping to the ends of open ones
+static QPointF pointAtLength(const Contour& contour, const std::vector<double>& arcLength, double s)
+{
+	const double total = arcLength.back();
+	if (total <= 0)
+	{
+		return QPointF(contour.points.front().x, contour.points.front().y);
+	}
+	if (contour.isClosed)
+	{
+		s = std::fmod(s, total);
+		if (s < 0)
+		{
+			s += total;
+		}
+	}
+	else
+	{
+		s = std::clamp(s, 0.0, total);
+	}
+
+	const size_t i = std::min<size_t>(std::upper_bound(arcLength.begin(), arcLength.end(), s) - arcLength.begin(), arcLength.size() - 1) - 1;
+	const double segment = arcLength[i + 1] - arcLength[i];
+	const double t = segment > 0 ? (s - arcLength[i]) / segment : 0.0;
+	const cv::Point& p0 = contour.points[i];
+	const cv::Point& p1 = contour.points[(i + 1) % contour.points.size()];
+	return QPointF(p0.x + t * (p1.x - p0.x), p0.y + t * (p1.y - p0.y));
+}
+
+void DrawOperations::drawContourValues(QPainter& painter, const Contour& contour, float width, QColor textColor, const QFont& font, int minTextDistance, LabelGrid& grid, bool saveToFile, bool saveBBtoFile, std::vector<BoundingBox>& bbox, const cv::Mat* gradient)
 {
 	painter.setPen(textColor);
 	painter.setFont(font);
@@ -100,36 +151,51 @@ void DrawOperations::drawContourValues(QPainter& painter, const Contour& contour
 		contourFolder = QDir(globalFolderName + "/" + contourFolderName);
 	}
 
-	// Draw text along the contour points
-	// Calc the text rotation angle according to the slope of the line
-	// Add rotated bounding rect of text to the clip path
+	// Draw numbers along the contour from the digit atlas
+	// Calc the rotation angle according to the contour tangent
+	// Add rotated bounding rect of each number to the clip path
+
+	// crops are read from the painter's device: a QImage is shared as is, a QPixmap copies only the crop;
+	// other devices (widgets, printers, pictures) cannot be read back, no crops are saved from them
+	const int deviceType = painter.device()->devType();
+	const QImage* targetImage = deviceType == QInternal::Image ? static_cast<const QImage*>(painter.device()) : nullptr;
+	const QPixmap* targetPixmap = deviceType == QInternal::Pixmap ? static_cast<const QPixmap*>(painter.device()) : nullptr;
+	const QRectF deviceRect(0, 0, painter.device()->width(), painter.device()->height());
 
-	double minDist = minTextDistance;
-	cv::Point prevPt;
-	for (size_t i = 0; i < contour.points.size(); i++)
+	if (contour.points.empty())
 	{
-		cv::Point pt1_cv = contour.points[i];
-		cv::Point pt2_cv = contour.points[(i + 1) % contour.points.size()];
+		drawContour(painter, contour, Qt::black, width);
+		return;
+	}
 
-		if(i != 0)
-		{
-			double dist = cv::norm(pt1_cv - prevPt);
-			if (dist < minDist)
-			{
-				continue;
-			}
-			double distEnd = cv::norm(pt1_cv - contour.points.back());
-			if (distEnd < minDist)
-			{
-				break;
-			}
-		}
-		prevPt = pt1_cv;
+	const DigitAtlas& atlas = DigitAtlas::get(font, textColor);
 
-		QPoint pt1 = { pt1_cv.x, pt1_cv.y };
-		QPoint pt2 = { pt2_cv.x, pt2_cv.y };
+	// cumulative arc length along the pixel chain, the closing segment included for closed contours
+	std::vector<double> arcLength;
+	cumulativeLength(contour, arcLength);
+	const double totalLength = arcLength.back();
+	const double spacing = std::max(minTextDistance, 1);
 
-		QLineF line(pt1, pt2);
+	// candidates every spacing pixels, the last one at least spacing away from the end
+	double s = 0;
+	while (s == 0 || s <= totalLength - spacing)
+	{
+		// generate random 4-digit number
+		int randomNum = RandomGenerator::instance().getRandomInt(9999);
+
+		QRectF textRect = atlas.textRect(randomNum);
+
+		// tangent over the label width
+		const QPointF pt1 = pointAtLength(contour, arcLength, s);
+		const double halfWidth = std::max(textRect.width() / 2, 1.0);
+		QLineF line(pointAtLength(contour, arcLength, s - halfWidth), pointAtLength(contour, arcLength, s + halfWidth));
+		if (gradient && !gradient->empty())
+		{
+			// isoline tangent is perpendicular to the gradient
+			const cv::Point at(std::clamp(cvRound(pt1.x()), 0, gradient->cols - 1), std::clamp(cvRound(pt1.y()), 0, gradient->rows - 1));
+			const cv::Vec2f grad = gradient->at<cv::Vec2f>(at);
+			line = QLineF(pt1, pt1 + QPointF(-grad[1], grad[0]));
+		}
 		double angle = line.angle();
 
 		if (angle > 180) 
@@ -144,47 +210,30 @@ void DrawOperations::drawContourValues(QPainter& painter, const Contour& contour
 
 		angle = 360 - angle;
 
-		QFont rotatedFont = font;
-		rotatedFont.setPointSize(10);
-		rotatedFont.setBold(true);
-
-		// generate random 4-digit number
-		int randomNum = RandomGenerator::instance().getRandomInt(9999);
-
-		QRectF textRect = painter.boundingRect(QRect(), Qt::AlignCenter, QString::number(randomNum));
-
 		QTransform transform;
 		transform.translate(pt1.x(), pt1.y());
 		transform.rotate(angle);
 
 		QRectF rotatedRect = transform.mapRect(textRect);
 
-		clipPath.addRect(rotatedRect);
-
-		painter.save();
-		painter.translate(pt1);
-		//painter.translate(-textRect.bottomRight());
-		painter.rotate(angle);
-
-
-		//painter.drawText(textRect, Qt::AlignCenter, QString::number(contour.depth + 1));
-		painter.drawText(textRect, Qt::AlignCenter, QString::number(randomNum));
-		//painter.drawRect(textRect);
-		painter.restore();
-		painter.resetTransform();
+		// overlaps a label of this or another contour: retry a bit further along
+		if (grid.intersects(rotatedRect))
+		{
+			s += halfWidth;
+			continue;
+		}
+		grid.insert(rotatedRect);
+		s += spacing;
 
-		// Теперь извлекаем часть изображения, содержащую этот текст
-		//QImage resultImage = painter.device().ima;  // Получаем текущее изображение
-		QPixmap resultImage = *(QPixmap*)painter.device();
+		clipPath.addRect(rotatedRect);
 
-		// Копируем часть изображения с числом
-		QImage numberImage = resultImage.toImage().copy(rotatedRect.toRect());
+		atlas.draw(painter, pt1, angle, randomNum);
 
 		if (!saveToFile && !saveBBtoFile)
 			continue;
 
-		// if number doesn't fit into resultImage, then skip it
-		if (rotatedRect.x() < 0 || rotatedRect.y() < 0 || rotatedRect.x() + rotatedRect.width() > resultImage.width() || rotatedRect.y() + rotatedRect.height() > resultImage.height())
+		// if number doesn't fit into the target, then skip it
+		if (!deviceRect.contains(rotatedRect))
 		{
 			continue;
 		}
@@ -193,10 +242,12 @@ void DrawOperations::drawContourValues(QPainter& painter, const Contour& contour
 			bbox.emplace_back(rotatedRect, QString::number(randomNum));
 		}
 
-		if (saveToFile) {
+		if (saveToFile && (targetImage || targetPixmap)) {
+			// crop only the label rect, straight from the render target when it is a QImage
+			QImage numberImage = targetImage ? targetImage->copy(rotatedRect.toRect()) : targetPixmap->copy(rotatedRect.toRect()).toImage();
+
 			// Сохраняем это изображение в уникальной папке
 			QString fileName = "contour_" + QString::number(randomNum) + ".png";
-			QString path = contourFolder.absoluteFilePath(fileName);
 			numberImage.save(contourFolder.absoluteFilePath(fileName), "PNG");
 
 			deleteFolder = false;
@@ -225,6 +276,20 @@ void DrawOperations::drawContour(QPainter& painter, const Contour& contour, QCol
 	QPen pen(color);
 	pen.setWidthF(width);
 	painter.setPen(pen);
+
+	if (!contour.vertices.empty())
+	{
+		// subpixel polyline
+		std::vector<QPointF> vertices;
+		vertices.reserve(contour.vertices.size());
+		for (auto& pt : contour.vertices)
+		{
+			vertices.emplace_back(pt.x, pt.y);
+		}
+		painter.drawPolyline(vertices.data(), static_cast<int>(vertices.size()));
+		return;
+	}
+
 	std::vector<QPoint> pts;
 	pts.reserve(contour.points.size());
 	for (auto& pt : contour.points)
@@ -234,3 +299,131 @@ void DrawOperations::drawContour(QPainter& painter, const Contour& contour, QCol
 
 	painter.drawPolyline(pts.data(), contour.points.size());
 }
+
+LabelGrid::LabelGrid(int width, int height, int cellSize)
+	: m_cellSize(std::max(cellSize, 1))
+{
+	m_cols = std::max((width + m_cellSize - 1) / m_cellSize, 1);
+	m_rows = std::max((height + m_cellSize - 1) / m_cellSize, 1);
+	m_head.assign(static_cast<size_t>(m_cols) * m_rows, -1);
+}
+
+QRect LabelGrid::cellRange(const QRectF& rect) const
+{
+	const int x0 = std::clamp(static_cast<int>(std::floor(rect.left() / m_cellSize)), 0, m_cols - 1);
+	const int y0 = std::clamp(static_cast<int>(std::floor(rect.top() / m_cellSize)), 0, m_rows - 1);
+	const int x1 = std::clamp(static_cast<int>(std::floor(rect.right() / m_cellSize)), 0, m_cols - 1);
+	const int y1 = std::clamp(static_cast<int>(std::floor(rect.bottom() / m_cellSize)), 0, m_rows - 1);
+	return QRect(QPoint(x0, y0), QPoint(x1, y1));
+}
+
+bool LabelGrid::intersects(const QRectF& rect) const
+{
+	const QRect cells = cellRange(rect);
+	for (int y = cells.top(); y <= cells.bottom(); ++y)
+	{
+		for (int x = cells.left(); x <= cells.right(); ++x)
+		{
+			for (int e = m_head[y * m_cols + x]; e >= 0; e = m_next[e])
+			{
+				if (m_rects[m_entryRect[e]].intersects(rect))
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void LabelGrid::insert(const QRectF& rect)
+{
+	const int id = static_cast<int>(m_rects.size());
+	m_rects.push_back(rect);
+
+	const QRect cells = cellRange(rect);
+	for (int y = cells.top(); y <= cells.bottom(); ++y)
+	{
+		for (int x = cells.left(); x <= cells.right(); ++x)
+		{
+			int& head = m_head[y * m_cols + x];
+			m_next.push_back(head);
+			m_entryRect.push_back(id);
+			head = static_cast<int>(m_next.size()) - 1;
+		}
+	}
+}
+
+DigitAtlas::DigitAtlas(const QFont& font, QColor color)
+{
+	const QFontMetricsF metrics(font);
+	m_height = metrics.height();
+	m_pad = static_cast<int>(std::ceil(m_height / 4));
+
+	const int cellHeight = static_cast<int>(std::ceil(m_height)) + 2 * m_pad;
+	int x = 0;
+	for (int d = 0; d < 10; ++d)
+	{
+		m_advance[d] = metrics.horizontalAdvance(QChar('0' + d));
+		m_cells[d] = QRect(x, 0, static_cast<int>(std::ceil(m_advance[d])) + 2 * m_pad, cellHeight);
+		x += m_cells[d].width();
+	}
+
+	m_glyphs = QImage(x, cellHeight, QImage::Format_ARGB32_Premultiplied);
+	m_glyphs.fill(Qt::transparent);
+
+	QPainter painter(&m_glyphs);
+	painter.setRenderHint(QPainter::TextAntialiasing);
+	painter.setFont(font);
+	painter.setPen(color);
+	for (int d = 0; d < 10; ++d)
+	{
+		painter.drawText(QPointF(m_cells[d].x() + m_pad, m_pad + metrics.ascent()), QString(QChar('0' + d)));
+	}
+}
+
+const DigitAtlas& DigitAtlas::get(const QFont& font, QColor color)
+{
+	static std::mutex mutex;
+	static std::map<std::pair<QString, QRgb>, std::unique_ptr<DigitAtlas>> atlases;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unique_ptr<DigitAtlas>& atlas = atlases[{ font.key(), color.rgba() }];
+	if (!atlas)
+	{
+		atlas = std::make_unique<DigitAtlas>(font, color);
+	}
+	return *atlas;
+}
+
+QRectF DigitAtlas::textRect(int value) const
+{
+	const QString text = QString::number(value);
+	qreal width = 0;
+	for (QChar c : text)
+	{
+		width += m_advance[c.digitValue()];
+	}
+	return QRectF(-width / 2, -m_height / 2, width, m_height);
+}
+
+void DigitAtlas::draw(QPainter& painter, const QPointF& origin, double angle, int value) const
+{
+	const QRectF rect = textRect(value);
+
+	painter.save();
+	painter.setRenderHint(QPainter::SmoothPixmapTransform);
+	painter.translate(origin);
+	painter.rotate(angle);
+
+	// pen position advances along the baseline, each cell carries its padding
+	qreal x = rect.left();
+	for (QChar c : QString::number(value))
+	{
+		const int d = c.digitValue();
+		painter.drawImage(QPointF(x - m_pad, rect.top() - m_pad), m_glyphs, m_cells[d]);
+		x += m_advance[d];
+	}
+
+	painter.restore();
+}
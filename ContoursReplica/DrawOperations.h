@@ -1,8 +1,11 @@
 #pragma once
 #include <qimage.h>
+#include <vector>
 
 struct Contour;
 
+namespace cv { class Mat; }
+
 struct WellParams
 {
 	int radius;
@@ -20,11 +23,53 @@ struct BoundingBox
 	QString value;
 };
 
+// Uniform grid of the label rects placed on one image, shared by all of its contours
+class LabelGrid
+{
+public:
+	LabelGrid(int width, int height, int cellSize = 32);
+	// true if rect overlaps a rect already inserted
+	bool intersects(const QRectF& rect) const;
+	void insert(const QRectF& rect);
+protected:
+	// cells covered by rect, clamped to the grid
+	QRect cellRange(const QRectF& rect) const;
+
+	int m_cellSize;
+	int m_cols;
+	int m_rows;
+	std::vector<QRectF> m_rects;
+	std::vector<int> m_head; // first entry of each cell, -1 if empty
+	std::vector<int> m_next; // next entry of the same cell
+	std::vector<int> m_entryRect; // index in m_rects of each entry
+};
+
+// Digits 0-9 rasterized once per (font, color); numbers are drawn as rotated blits of them, without text shaping
+class DigitAtlas
+{
+public:
+	DigitAtlas(const QFont& font, QColor color);
+	// shared atlas, built on first use
+	static const DigitAtlas& get(const QFont& font, QColor color);
+	// same rect as QPainter::boundingRect(QRect(), Qt::AlignCenter, QString::number(value))
+	QRectF textRect(int value) const;
+	// value centred on origin, rotated by angle degrees
+	void draw(QPainter& painter, const QPointF& origin, double angle, int value) const;
+protected:
+	QImage m_glyphs; // ARGB32_Premultiplied, one padded cell per digit
+	QRect m_cells[10];
+	qreal m_advance[10];
+	qreal m_height;
+	int m_pad; // transparent margin around each glyph for overhangs
+};
+
 namespace DrawOperations
 {
-	void drawRandomWell(QPixmap& image, const WellParams& params);
+	void drawRandomWell(QImage& image, const WellParams& params);
 	void drawWellTitle(QPainter& painter, const QPoint& wellPt, const WellParams& params);
-	void drawContourValues(QPainter& painter, const Contour& contour, float width, QColor textColor, const QFont& font, int minTextDistance, bool saveToFile, bool saveBBtoFile, std::vector<BoundingBox>& bbox);
+	// labels are placed every minTextDistance pixels of arc length, skipping those that overlap a label in grid
+	// gradient (optional, CV_32FC2 in contour coordinates) orients labels along the analytic isoline tangent
+	void drawContourValues(QPainter& painter, const Contour& contour, float width, QColor textColor, const QFont& font, int minTextDistance, LabelGrid& grid, bool saveToFile, bool saveBBtoFile, std::vector<BoundingBox>& bbox, const cv::Mat* gradient = nullptr);
 	void drawContour(QPainter& painter, const Contour& contour, QColor color, float width);
 };
 
@@ -0,0 +1,115 @@
+#include "ImageKernels.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuidex(r, leaf, subleaf);
+	for (int i = 0; i < 4; ++i)
+	{
+		regs[i] = static_cast<unsigned int>(r[i]);
+	}
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+CpuLevel ImageKernels::detectCpu()
+{
+	unsigned int regs[4];
+	cpuid(0, 0, regs);
+	const unsigned int maxLeaf = regs[0];
+
+	cpuid(1, 0, regs);
+	const unsigned int ecx1 = regs[2];
+	if (!(ecx1 & (1u << 20))) // SSE4.2
+	{
+		return CpuLevel::sse2;
+	}
+
+	// AVX state must be enabled by the OS (OSXSAVE and XCR0 bits 1-2)
+	const bool osxsave = (ecx1 & (1u << 27)) != 0;
+	const unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+	const bool avx = (ecx1 & (1u << 28)) && (ecx1 & (1u << 12)) && (xcr0 & 0x6) == 0x6; // AVX, FMA
+	if (!avx || maxLeaf < 7)
+	{
+		return CpuLevel::sse42;
+	}
+
+	cpuid(7, 0, regs);
+	const unsigned int ebx7 = regs[1];
+	if (!(ebx7 & (1u << 5)) || !(ebx7 & (1u << 3)) || !(ebx7 & (1u << 8))) // AVX2, BMI1, BMI2
+	{
+		return CpuLevel::sse42;
+	}
+
+	// AVX-512 F, DQ, BW, VL (what /arch:AVX512 assumes) and opmask/ZMM state (XCR0 bits 5-7)
+	const unsigned int avx512 = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31);
+	if ((ebx7 & avx512) == avx512 && (xcr0 & 0xe0) == 0xe0)
+	{
+		return CpuLevel::avx512;
+	}
+	return CpuLevel::avx2;
+}
+#else
+CpuLevel ImageKernels::detectCpu()
+{
+	return CpuLevel::sse2;
+}
+#endif
+
+const char* ImageKernels::levelName(CpuLevel level)
+{
+	switch (level)
+	{
+	case CpuLevel::sse42:
+		return "SSE4.2";
+	case CpuLevel::avx2:
+		return "AVX2";
+	case CpuLevel::avx512:
+		return "AVX-512";
+	default:
+		return "SSE2";
+	}
+}
+
+const ImageKernels::Table& ImageKernels::kernels()
+{
+	static const Table& table = []() -> const Table&
+		{
+			switch (detectCpu())
+			{
+			case CpuLevel::avx512:
+				return avx512Table();
+			case CpuLevel::avx2:
+				return avx2Table();
+			default:
+				// there is no separate SSE4.2 build, the kernels gain nothing from it
+				return sse2Table();
+			}
+		}();
+	return table;
+}
+
+std::string ImageKernels::description()
+{
+	return std::string(levelName(kernels().level)) + " kernels (CPU: " + levelName(detectCpu()) + ")";
+}
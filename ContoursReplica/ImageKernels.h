@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Instruction set levels of the image kernels
+enum class CpuLevel
+{
+    sse2,
+    sse42,
+    avx2,
+    avx512
+};
+
+namespace ImageKernels
+{
+    // Noise of one map as the row kernels see it
+    struct Noise
+    {
+        const std::uint8_t* permutation; // 256 entry Perlin permutation, nullptr selects OpenSimplex2S
+        std::uint64_t seed; // OpenSimplex2S seed
+        std::int32_t periodX, periodY; // Perlin period in lattice cells (1..256)
+    };
+
+    // One build of the hot row kernels, every entry compiled for the same instruction set.
+    // Only raw pointers and plain values cross the table: the Mat setup, buffers and threading
+    // stay in ContoursOperations.cpp, which is compiled for the baseline instruction set
+    struct Table
+    {
+        CpuLevel level;
+        // Noise in [0, 1] at x = (first + i) * dx and y, for i < count
+        void (*noiseRow32)(const Noise& noise, std::int64_t first, float dx, float y, float* out, int count);
+        void (*noiseRow64)(const Noise& noise, std::int64_t first, double dx, double y, double* out, int count);
+        // Isoline mask (255 off the lines) of rows output rows of frac(noise * mul); noise starts 1 row and
+        // 1 column before the first output pixel, steps are in elements, scratch holds 7 * cols + 2 values
+        void (*isolineRows32)(const float* noise, std::size_t noiseStep, float mul, unsigned char* out, std::size_t outStep, int cols, int rows, float* scratch);
+        void (*isolineRows64)(const double* noise, std::size_t noiseStep, double mul, unsigned char* out, std::size_t outStep, int cols, int rows, double* scratch);
+        // Isoline mask and interleaved gradient of noise * mul of the row at global pixel (first, row)
+        // from the analytic noise gradient; scratch holds 3 * count values
+        void (*analyticIsolineRow32)(const Noise& noise, std::int64_t first, int row, float xMul, float yMul, float mul, unsigned char* out, float* gradient, float* scratch, int count);
+        void (*analyticIsolineRow64)(const Noise& noise, std::int64_t first, int row, double xMul, double yMul, double mul, unsigned char* out, float* gradient, double* scratch, int count);
+        // Sets bit x % 64 of word x / 64 of out for every pixel x >= 128 of a CV_8UC1 row, out starts zeroed
+        void (*packMaskRow)(const unsigned char* in, std::uint64_t* out, int cols);
+        // One Guo-Hall sub-iteration (pass 0 or 1) over rows [jBegin, jEnd) of a packed image with words
+        // per row: marks the removable pixels in marker, returns whether any was marked
+        bool (*thinningRows)(const std::uint64_t* img, std::uint64_t* marker, const std::uint64_t* interior, int words, int jBegin, int jEnd, int pass);
+        // Pixels of a BGR / BGRA row with a region id >= 0 take the colour of their region, the others are kept
+        void (*fillRegionsRow3)(const int* regions, const unsigned char* colors, unsigned char* row, int count);
+        void (*fillRegionsRow4)(const int* regions, const std::uint32_t* colors, std::uint32_t* row, int count);
+    };
+
+    // Highest level supported by both the CPU (CPUID) and the OS (XGETBV)
+    CpuLevel detectCpu();
+    const char* levelName(CpuLevel level);
+    // Best build for this machine, selected on first use
+    const Table& kernels();
+    // e.g. "AVX2 kernels (CPU: AVX-512)"
+    std::string description();
+
+    // Builds, defined in ImageKernels_<isa>.cpp
+    const Table& sse2Table();
+    const Table& avx2Table();
+    const Table& avx512Table();
+};
@@ -0,0 +1,261 @@
+// Row kernels built once per instruction set. Included by ImageKernels_<isa>.cpp, which define
+// IMAGE_KERNELS_LEVEL and IMAGE_KERNELS_TABLE and are compiled for that instruction set.
+// Inline functions of shared headers (OpenCV, the standard library) are merged by the linker,
+// which keeps an arbitrary build of each, so nothing here calls them: the kernels work on raw
+// pointers, the helpers below have internal linkage and the noise headers live in their own
+// inline namespace (SIVPERLIN_ABI) and avoid the standard library on their row paths.
+
+#include "ImageKernels.h"
+#include "PerlinNoise.hpp"
+#include "OpenSimplex2S.hpp"
+#include <math.h>
+#include <emmintrin.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+inline float floorOf(float x)
+{
+	return floorf(x);
+}
+
+inline double floorOf(double x)
+{
+	return floor(x);
+}
+
+template <class Float>
+inline Float absOf(Float x)
+{
+	return x < 0 ? -x : x;
+}
+
+template <class Float>
+inline Float minOf(Float a, Float b)
+{
+	return b < a ? b : a;
+}
+
+// Round half to even, as cvRound
+inline int roundOf(float x)
+{
+	return _mm_cvtss_si32(_mm_set_ss(x));
+}
+
+inline int roundOf(double x)
+{
+	return _mm_cvtsd_si32(_mm_set_sd(x));
+}
+
+// Calls f with the noise backend of noise, built for this instruction set
+template <class Float, class F>
+void withNoise(const ImageKernels::Noise& noise, F&& f)
+{
+	if (noise.permutation)
+	{
+		f(siv::BasicPerlinNoise<Float>(noise.permutation));
+	}
+	else
+	{
+		f(BasicOpenSimplex2S<Float>(noise.seed));
+	}
+}
+
+template <class Float>
+void noiseRow(const ImageKernels::Noise& noise, std::int64_t first, Float dx, Float y, Float* out, int count)
+{
+	withNoise<Float>(noise, [&](const auto& n)
+		{
+			n.noise2D_01_periodic_row(first, dx, y, noise.periodX, noise.periodY, out, count);
+		});
+}
+
+// Isoline mask of the fractional field frac(noise * mul) in a single pass over rows.
+// Fuses Sobel x/y, convertScaleAbs, addWeighted(0.5, 0.5), the 0/1/255 threshold and the
+// inversion: out = 255 where round|gx| + round|gy| <= 2, else 0. The Sobel sums are formed
+// in the same order as OpenCV's separable filter.
+template <class Float>
+void isolineRows(const Float* noise, std::size_t noiseStep, Float mul, unsigned char* out, std::size_t outStep, int cols, int rows, Float* scratch)
+{
+	// rolling horizontal derivative (d) and smoothing (s) rows of the fractional field
+	Float* frac = scratch;
+	Float* d[3] = { scratch + cols + 2, scratch + 2 * cols + 2, scratch + 3 * cols + 2 };
+	Float* s[3] = { scratch + 4 * cols + 2, scratch + 5 * cols + 2, scratch + 6 * cols + 2 };
+
+	auto prepare = [&](int y, Float* dRow, Float* sRow)
+		{
+			const Float* src = noise + y * noiseStep;
+			for (int i = 0; i < cols + 2; ++i)
+			{
+				Float value = src[i] * mul;
+				frac[i] = value - floorOf(value);
+			}
+			for (int i = 0; i < cols; ++i)
+			{
+				dRow[i] = frac[i + 2] - frac[i];
+				sRow[i] = 2 * frac[i + 1] + (frac[i] + frac[i + 2]);
+			}
+		};
+
+	prepare(0, d[0], s[0]);
+	prepare(1, d[1], s[1]);
+
+	for (int j = 0; j < rows; ++j)
+	{
+		prepare(j + 2, d[2], s[2]);
+
+		unsigned char* dst = out + j * outStep;
+		for (int i = 0; i < cols; ++i)
+		{
+			const Float gx = 2 * d[1][i] + (d[0][i] + d[2][i]);
+			const Float gy = s[2][i] - s[0][i];
+			dst[i] = (roundOf(absOf(gx)) + roundOf(absOf(gy)) <= 2) ? 255 : 0;
+		}
+
+		Float* dFirst = d[0];
+		d[0] = d[1];
+		d[1] = d[2];
+		d[2] = dFirst;
+		Float* sFirst = s[0];
+		s[0] = s[1];
+		s[1] = s[2];
+		s[2] = sFirst;
+	}
+}
+
+// Isoline mask from the analytic noise gradient: a pixel is on an isoline when the nearest
+// integer level of noise * mul is within one pixel (L1 of the per-pixel gradient).
+template <class Float>
+void analyticIsolineRow(const ImageKernels::Noise& noise, std::int64_t first, int row, Float xMul, Float yMul, Float mul, unsigned char* out, float* gradient, Float* scratch, int count)
+{
+	Float* value = scratch;
+	Float* gradX = scratch + count;
+	Float* gradY = scratch + 2 * count;
+
+	const Float y = static_cast<Float>(row) * yMul;
+	withNoise<Float>(noise, [&](const auto& n)
+		{
+			n.noise2D_grad_periodic_row(first, xMul, y, noise.periodX, noise.periodY, value, gradX, gradY, count);
+		});
+
+	// noise2D_01 = noise2D / 2 + 1 / 2
+	const Float scaleX = mul * xMul / 2;
+	const Float scaleY = mul * yMul / 2;
+	for (int i = 0; i < count; ++i)
+	{
+		const Float level = (value[i] / 2 + Float(0.5)) * mul;
+		const Float frac = level - floorOf(level);
+		const Float gx = gradX[i] * scaleX;
+		const Float gy = gradY[i] * scaleY;
+		out[i] = (minOf(frac, 1 - frac) <= absOf(gx) + absOf(gy)) ? 0 : 255;
+		gradient[2 * i] = static_cast<float>(gx);
+		gradient[2 * i + 1] = static_cast<float>(gy);
+	}
+}
+
+void packMaskRow(const unsigned char* in, std::uint64_t* out, int cols)
+{
+	int i = 0;
+#if defined(__AVX2__)
+	for (; i + 32 <= cols; i += 32)
+	{
+		const std::uint64_t bits = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i))));
+		out[i / 64] |= bits << (i % 64);
+	}
+#endif
+	for (; i < cols; ++i)
+	{
+		out[i / 64] |= static_cast<std::uint64_t>(in[i] >> 7) << (i % 64);
+	}
+}
+
+// Guo-Hall thinning on rows packed into 64 pixel words, bit x % 64 of word x / 64 is pixel x.
+// Every rule of cv::ximgproc::thinning(THINNING_GUOHALL) is evaluated for 64 pixels at once
+// with bitwise logic, so the result is identical to it.
+bool thinningRows(const std::uint64_t* img, std::uint64_t* marker, const std::uint64_t* interior, int words, int jBegin, int jEnd, int pass)
+{
+	bool changed = false;
+	for (int j = jBegin; j < jEnd; ++j)
+	{
+		const std::uint64_t* up = img + static_cast<std::size_t>(j - 1) * words;
+		const std::uint64_t* row = img + static_cast<std::size_t>(j) * words;
+		const std::uint64_t* down = img + static_cast<std::size_t>(j + 1) * words;
+		std::uint64_t* mark = marker + static_cast<std::size_t>(j) * words;
+		for (int w = 0; w < words; ++w)
+		{
+			// neighbour at x + 1 (east) and x - 1 (west) moved onto bit x
+			auto east = [&](const std::uint64_t* r) { return (r[w] >> 1) | (w + 1 < words ? r[w + 1] << 63 : 0); };
+			auto west = [&](const std::uint64_t* r) { return (r[w] << 1) | (w > 0 ? r[w - 1] >> 63 : 0); };
+
+			const std::uint64_t p2 = up[w], p3 = east(up), p4 = east(row), p5 = east(down);
+			const std::uint64_t p6 = down[w], p7 = west(down), p8 = west(row), p9 = west(up);
+
+			// C == 1: exactly one of the four transitions
+			const std::uint64_t t1 = ~p2 & (p3 | p4), t2 = ~p4 & (p5 | p6), t3 = ~p6 & (p7 | p8), t4 = ~p8 & (p9 | p2);
+			const std::uint64_t c1 = (t1 ^ t2 ^ t3 ^ t4) & ~((t1 & t2) | (t3 & t4) | ((t1 | t2) & (t3 | t4)));
+
+			// 2 <= min(N1, N2) <= 3: both sums are at least 2 and one of them is not 4
+			const std::uint64_t a1 = p9 | p2, a2 = p3 | p4, a3 = p5 | p6, a4 = p7 | p8;
+			const std::uint64_t b1 = p2 | p3, b2 = p4 | p5, b3 = p6 | p7, b4 = p8 | p9;
+			const std::uint64_t n1 = (a1 & a2) | (a3 & a4) | ((a1 | a2) & (a3 | a4));
+			const std::uint64_t n2 = (b1 & b2) | (b3 & b4) | ((b1 | b2) & (b3 | b4));
+			const std::uint64_t n = n1 & n2 & ~(a1 & a2 & a3 & a4 & b1 & b2 & b3 & b4);
+
+			const std::uint64_t m = (pass == 0) ? ((p6 | p7 | ~p9) & p8) : ((p2 | p3 | ~p5) & p4);
+
+			mark[w] = row[w] & c1 & n & ~m & interior[w];
+			changed |= (mark[w] != 0);
+		}
+	}
+	return changed;
+}
+
+// One pass over a row, contour pixels keep their colour
+void fillRegionsRow3(const int* regions, const unsigned char* colors, unsigned char* row, int count)
+{
+	for (int x = 0; x < count; ++x)
+	{
+		if (regions[x] >= 0)
+		{
+			const unsigned char* color = colors + 3 * regions[x];
+			row[3 * x] = color[0];
+			row[3 * x + 1] = color[1];
+			row[3 * x + 2] = color[2];
+		}
+	}
+}
+
+void fillRegionsRow4(const int* regions, const std::uint32_t* colors, std::uint32_t* row, int count)
+{
+	for (int x = 0; x < count; ++x)
+	{
+		if (regions[x] >= 0)
+		{
+			row[x] = colors[regions[x]];
+		}
+	}
+}
+
+}
+
+const ImageKernels::Table& ImageKernels::IMAGE_KERNELS_TABLE()
+{
+	static const Table table{
+		IMAGE_KERNELS_LEVEL,
+		&noiseRow<float>,
+		&noiseRow<double>,
+		&isolineRows<float>,
+		&isolineRows<double>,
+		&analyticIsolineRow<float>,
+		&analyticIsolineRow<double>,
+		&packMaskRow,
+		&thinningRows,
+		&fillRegionsRow3,
+		&fillRegionsRow4
+	};
+	return table;
+}
@@ -0,0 +1,5 @@
+// AVX2 build of the image kernels, compiled with /arch:AVX2
+#define SIVPERLIN_ABI abi_avx2
+#define IMAGE_KERNELS_LEVEL CpuLevel::avx2
+#define IMAGE_KERNELS_TABLE avx2Table
+#include "ImageKernels.inl"
@@ -0,0 +1,5 @@
+// AVX-512 build of the image kernels, compiled with /arch:AVX512
+#define SIVPERLIN_ABI abi_avx512
+#define IMAGE_KERNELS_LEVEL CpuLevel::avx512
+#define IMAGE_KERNELS_TABLE avx512Table
+#include "ImageKernels.inl"
@@ -0,0 +1,5 @@
+// SSE2 build of the image kernels, the baseline build, also used on SSE4.2 machines
+#define SIVPERLIN_ABI abi_sse2
+#define IMAGE_KERNELS_LEVEL CpuLevel::sse2
+#define IMAGE_KERNELS_TABLE sse2Table
+#include "ImageKernels.inl"
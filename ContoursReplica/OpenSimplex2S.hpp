@@ -0,0 +1,404 @@
+//----------------------------------------------------------------------------------------
+//
+//	OpenSimplex2S
+//	2D OpenSimplex2S (SuperSimplex) noise with the row interface of siv::PerlinNoise
+//
+//	Lattice, hashing and gradient set follow the public domain OpenSimplex2
+//	reference implementation by K.jpg (https://github.com/KdotJPG/OpenSimplex2).
+//
+//----------------------------------------------------------------------------------------
+
+# pragma once
+# include <cstddef>
+# include <cstdint>
+# include <algorithm>
+# include <cmath>
+# include <type_traits>
+# include "PerlinNoise.hpp"
+
+
+inline namespace SIVPERLIN_ABI {
+
+namespace opensimplex_detail
+{
+	using siv::perlin_detail::Floor;
+	using siv::perlin_detail::Lanes;
+	using siv::perlin_detail::ScalarLanes;
+
+	inline constexpr double Skew = 0.366025403784439; // (sqrt(3) - 1) / 2
+	inline constexpr double Unskew = -0.21132486540518713; // (1 / sqrt(3) - 1) / 2
+	inline constexpr double RSquared = 2.0 / 3.0; // squared kernel radius
+	inline constexpr double Normalizer = 0.05481866495625118; // scales the output to about [-1, 1]
+
+	inline constexpr std::uint64_t PrimeX = 0x5205402B9270C86FULL;
+	inline constexpr std::uint64_t PrimeY = 0x598CD327003817B5ULL;
+	inline constexpr std::uint64_t HashMultiplier = 0x53A3F72DEEC546F5ULL;
+
+	// 24 unit gradients; the reference table of 128 repeats them
+	inline constexpr std::size_t GradientCount = 24;
+
+	// interleaved x, y; a plain array so lookups call no std::array members
+	template <class Float>
+	struct GradientTable
+	{
+		Float values[GradientCount * 2];
+	};
+
+	template <class Float>
+	inline const GradientTable<Float>& Gradients() noexcept
+	{
+		static const GradientTable<Float> gradients = []()
+			{
+				const double base[GradientCount * 2] = {
+					0.38268343236509, 0.923879532511287,
+					0.923879532511287, 0.38268343236509,
+					0.923879532511287, -0.38268343236509,
+					0.38268343236509, -0.923879532511287,
+					-0.38268343236509, -0.923879532511287,
+					-0.923879532511287, -0.38268343236509,
+					-0.923879532511287, 0.38268343236509,
+					-0.38268343236509, 0.923879532511287,
+					0.130526192220052, 0.99144486137381,
+					0.608761429008721, 0.793353340291235,
+					0.793353340291235, 0.608761429008721,
+					0.99144486137381, 0.130526192220051,
+					0.99144486137381, -0.130526192220051,
+					0.793353340291235, -0.60876142900872,
+					0.608761429008721, -0.793353340291235,
+					0.130526192220052, -0.99144486137381,
+					-0.130526192220052, -0.99144486137381,
+					-0.608761429008721, -0.793353340291235,
+					-0.793353340291235, -0.608761429008721,
+					-0.99144486137381, -0.130526192220052,
+					-0.99144486137381, 0.130526192220051,
+					-0.793353340291235, 0.608761429008721,
+					-0.608761429008721, 0.793353340291235,
+					-0.130526192220052, 0.99144486137381 };
+
+				GradientTable<Float> result{};
+				for (std::size_t i = 0; i < GradientCount * 2; ++i)
+				{
+					result.values[i] = static_cast<Float>(base[i] / Normalizer);
+				}
+				return result;
+			}();
+		return gradients;
+	}
+
+	// Gradient of the lattice vertex with premultiplied coordinates (xsvp, ysvp)
+	template <class Float>
+	inline void Gradient(const std::uint64_t seed, const std::uint64_t xsvp, const std::uint64_t ysvp, Float& gx, Float& gy) noexcept
+	{
+		std::uint64_t hash = (seed ^ xsvp ^ ysvp) * HashMultiplier;
+		hash ^= static_cast<std::uint64_t>(static_cast<std::int64_t>(hash) >> 58);
+		const std::size_t index = ((static_cast<std::size_t>(hash) & 254) >> 1) % GradientCount;
+		gx = Gradients<Float>().values[index * 2];
+		gy = Gradients<Float>().values[index * 2 + 1];
+	}
+
+	////////////////////////////////////////////////
+	//
+	//	Candidate vertices of a skewed cell: (0, 0) and (1, 1) always contribute,
+	//	one of each of the other pairs depending on where the sample lies in the cell.
+	//
+	inline constexpr int CandidateX[8] = { 0, 1, 0, 2, 1, 1, -1, 0 };
+	inline constexpr int CandidateY[8] = { 0, 1, 1, 1, 0, 2, 0, -1 };
+
+	// Skewed cell of (x, y) and the selection of its contributing vertices
+	struct RunKey
+	{
+		std::int64_t xsb, ysb;
+		int vertex[4];
+
+		[[nodiscard]]
+		bool operator ==(const RunKey& other) const noexcept
+		{
+			return (xsb == other.xsb) && (ysb == other.ysb) && (vertex[2] == other.vertex[2]) && (vertex[3] == other.vertex[3]);
+		}
+	};
+
+	template <class Float>
+	[[nodiscard]]
+	inline RunKey Locate(const Float x, const Float y) noexcept
+	{
+		const Float s = static_cast<Float>(Skew) * (x + y);
+		const Float xs = x + s;
+		const Float ys = y + s;
+
+		const Float _xs = Floor(xs);
+		const Float _ys = Floor(ys);
+		const Float xi = xs - _xs;
+		const Float yi = ys - _ys;
+
+		RunKey key{ static_cast<std::int64_t>(_xs), static_cast<std::int64_t>(_ys), { 0, 1, 0, 0 } };
+
+		const Float t = (xi + yi) * static_cast<Float>(Unskew);
+		const Float xmyi = xi - yi;
+		if (t < static_cast<Float>(Unskew))
+		{
+			key.vertex[2] = (xi + xmyi > 1) ? 3 : 2;
+			key.vertex[3] = (yi - xmyi > 1) ? 5 : 4;
+		}
+		else
+		{
+			key.vertex[2] = (xi + xmyi < 0) ? 6 : 4;
+			key.vertex[3] = (yi < xmyi) ? 7 : 2;
+		}
+		return key;
+	}
+
+	////////////////////////////////////////////////
+	//
+	//	Along a row y is constant, and inside one skewed cell the vertex selection
+	//	only changes where a linear function of x changes sign. Samples with the
+	//	same RunKey share four fixed vertices, so a^4 * g.d of each one reduces to
+	//	a polynomial in x with per-run constants.
+	//
+	template <class Float>
+	struct RowRun
+	{
+		Float px[4]; // vertex x in unskewed space
+		Float gx[4]; // gradient x
+		Float gy[4]; // gradient y
+		Float dy[4]; // y - vertex y
+		Float r[4]; // r^2 - dy^2
+		Float c[4]; // gy * dy
+	};
+
+	template <class Float>
+	[[nodiscard]]
+	inline RowRun<Float> MakeRowRun(const std::uint64_t seed, const RunKey& key, const Float y) noexcept
+	{
+		const std::uint64_t xsbp = static_cast<std::uint64_t>(key.xsb) * PrimeX;
+		const std::uint64_t ysbp = static_cast<std::uint64_t>(key.ysb) * PrimeY;
+
+		RowRun<Float> run;
+		for (std::size_t k = 0; k < 4; ++k)
+		{
+			const std::int64_t vx = key.xsb + CandidateX[key.vertex[k]];
+			const std::int64_t vy = key.ysb + CandidateY[key.vertex[k]];
+			const double u = static_cast<double>(vx + vy) * Unskew;
+			const Float dy = y - static_cast<Float>(static_cast<double>(vy) + u);
+
+			run.px[k] = static_cast<Float>(static_cast<double>(vx) + u);
+			Gradient(seed, xsbp + static_cast<std::uint64_t>(CandidateX[key.vertex[k]]) * PrimeX, ysbp + static_cast<std::uint64_t>(CandidateY[key.vertex[k]]) * PrimeY, run.gx[k], run.gy[k]);
+			run.dy[k] = dy;
+			run.r[k] = static_cast<Float>(RSquared) - dy * dy;
+			run.c[k] = run.gy[k] * dy;
+		}
+		return run;
+	}
+
+	// Sum of a^4 * g.d over the four vertices, a = max(r^2 - |d|^2, 0).
+	// The gradient is a^4 g - 8 a^3 (g.d) d.
+	template <class Float, class Vec, class L = Lanes<Float>, bool WithGradient = false>
+	inline void RowRunNoise(const RowRun<Float>& run, const Vec x, Vec& value, Vec& gradX, Vec& gradY) noexcept
+	{
+		const Vec zero = L::set1(Float(0));
+		const Vec m8 = L::set1(Float(-8));
+
+		value = gradX = gradY = zero;
+
+		for (std::size_t k = 0; k < 4; ++k)
+		{
+			const Vec dx = L::sub(x, L::set1(run.px[k]));
+			const Vec a = L::max(L::sub(L::set1(run.r[k]), L::mul(dx, dx)), zero);
+			const Vec a2 = L::mul(a, a);
+			const Vec a4 = L::mul(a2, a2);
+			const Vec dot = L::add(L::mul(L::set1(run.gx[k]), dx), L::set1(run.c[k]));
+
+			value = L::add(value, L::mul(a4, dot));
+
+			if constexpr (WithGradient)
+			{
+				const Vec s = L::mul(m8, L::mul(L::mul(a2, a), dot));
+				gradX = L::add(gradX, L::add(L::mul(a4, L::set1(run.gx[k])), L::mul(s, dx)));
+				gradY = L::add(gradY, L::add(L::mul(a4, L::set1(run.gy[k])), L::mul(s, L::set1(run.dy[k]))));
+			}
+		}
+	}
+}
+
+template <class Float>
+class BasicOpenSimplex2S
+{
+public:
+
+	static_assert(std::is_floating_point_v<Float>);
+
+	///////////////////////////////////////
+	//
+	//	Typedefs
+	//
+
+	using value_type = Float;
+
+	using seed_type = std::uint64_t;
+
+	///////////////////////////////////////
+	//
+	//	Constructors
+	//
+
+	constexpr BasicOpenSimplex2S() noexcept : m_seed{ 0 } {}
+
+	explicit constexpr BasicOpenSimplex2S(const seed_type seed) noexcept : m_seed{ seed } {}
+
+	///////////////////////////////////////
+	//
+	//	Reseed
+	//
+
+	void reseed(const seed_type seed) noexcept { m_seed = seed; }
+
+	///////////////////////////////////////
+	//
+	//	Noise (The result is in the range [-1, 1])
+	//
+
+	[[nodiscard]]
+	value_type noise2D(const value_type x, const value_type y) const noexcept
+	{
+		value_type out;
+		rowNoise<false>(x, 0, value_type(0), y, &out, nullptr, nullptr, 1);
+		return out;
+	}
+
+	///////////////////////////////////////
+	//
+	//	Noise (The result is remapped to the range [0, 1])
+	//
+
+	[[nodiscard]]
+	value_type noise2D_01(const value_type x, const value_type y) const noexcept
+	{
+		return noise2D(x, y) * value_type(0.5) + value_type(0.5);
+	}
+
+	///////////////////////////////////////
+	//
+	//	Row noise (out[i] = noise2D(x0 + i * dx, y), count consecutive samples)
+	//
+
+	void noise2D_row(const value_type x0, const value_type dx, const value_type y, value_type* const out, const std::size_t count) const noexcept
+	{
+		rowNoise<false>(x0, 0, dx, y, out, nullptr, nullptr, count);
+	}
+
+	void noise2D_01_row(const value_type x0, const value_type dx, const value_type y, value_type* const out, const std::size_t count) const noexcept
+	{
+		noise2D_row(x0, dx, y, out, count);
+		remap01(out, count);
+	}
+
+	///////////////////////////////////////
+	//
+	//	Periodic row noise (out[i] = noise2D((first + i) * dx, y))
+	//	The simplex lattice has no axis-aligned period, periodX and periodY are accepted
+	//	for interface parity with siv::PerlinNoise and ignored.
+	//
+
+	void noise2D_01_periodic_row(const std::int64_t first, const value_type dx, const value_type y, const std::int32_t, const std::int32_t, value_type* const out, const std::size_t count) const noexcept
+	{
+		rowNoise<false>(value_type(0), first, dx, y, out, nullptr, nullptr, count);
+		remap01(out, count);
+	}
+
+	///////////////////////////////////////
+	//
+	//	Noise with its analytic gradient (value in [-1, 1], gradient w.r.t. x and y)
+	//
+
+	[[nodiscard]]
+	value_type noise2D_grad(const value_type x, const value_type y, value_type& gradX, value_type& gradY) const noexcept
+	{
+		value_type out;
+		rowNoise<true>(x, 0, value_type(0), y, &out, &gradX, &gradY, 1);
+		return out;
+	}
+
+	void noise2D_grad_row(const value_type x0, const value_type dx, const value_type y, value_type* const out, value_type* const gradX, value_type* const gradY, const std::size_t count) const noexcept
+	{
+		rowNoise<true>(x0, 0, dx, y, out, gradX, gradY, count);
+	}
+
+	void noise2D_grad_periodic_row(const std::int64_t first, const value_type dx, const value_type y, const std::int32_t, const std::int32_t, value_type* const out, value_type* const gradX, value_type* const gradY, const std::size_t count) const noexcept
+	{
+		rowNoise<true>(value_type(0), first, dx, y, out, gradX, gradY, count);
+	}
+
+	///////////////////////////////////////
+	//
+	//	Seed
+	//
+
+	[[nodiscard]]
+	constexpr seed_type seed() const noexcept { return m_seed; }
+
+private:
+
+	seed_type m_seed;
+
+	static void remap01(value_type* const out, const std::size_t count) noexcept
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			out[i] = out[i] * value_type(0.5) + value_type(0.5);
+		}
+	}
+
+	template <bool WithGradient>
+	void rowNoise(const value_type x0, const std::int64_t first, const value_type dx, const value_type y, value_type* const out, value_type* const gradX, value_type* const gradY, const std::size_t count) const noexcept
+	{
+		using Lanes = opensimplex_detail::Lanes<value_type>;
+		using Scalar = opensimplex_detail::ScalarLanes<value_type>;
+		using Vec = typename Lanes::type;
+
+		const auto position = [=](const std::size_t i) { return x0 + static_cast<value_type>(first + static_cast<std::int64_t>(i)) * dx; };
+
+		std::size_t i = 0;
+
+		while (i < count)
+		{
+			const std::size_t runFirst = i;
+			const opensimplex_detail::RunKey key = opensimplex_detail::Locate(position(i), y);
+			const opensimplex_detail::RowRun<value_type> run = opensimplex_detail::MakeRowRun(m_seed, key, y);
+
+			// full lanes inside the run (every selection test is linear in x within a cell,
+			// so checking the last lane is enough)
+			while (i + Lanes::width <= count
+				&& opensimplex_detail::Locate(position(i + Lanes::width - 1), y) == key)
+			{
+				const Vec x = Lanes::add(Lanes::set1(x0), Lanes::mul(Lanes::ramp(first + static_cast<std::int64_t>(i)), Lanes::set1(dx)));
+				Vec value, gx, gy;
+				opensimplex_detail::RowRunNoise<value_type, Vec, Lanes, WithGradient>(run, x, value, gx, gy);
+				Lanes::store(out + i, value);
+				if constexpr (WithGradient)
+				{
+					Lanes::store(gradX + i, gx);
+					Lanes::store(gradY + i, gy);
+				}
+				i += Lanes::width;
+			}
+
+			// remaining samples inside the run (always including the one that started it)
+			while (i < count
+				&& (i == runFirst || opensimplex_detail::Locate(position(i), y) == key))
+			{
+				value_type value, gx, gy;
+				opensimplex_detail::RowRunNoise<value_type, value_type, Scalar, WithGradient>(run, position(i), value, gx, gy);
+				out[i] = value;
+				if constexpr (WithGradient)
+				{
+					gradX[i] = gx;
+					gradY[i] = gy;
+				}
+				++i;
+			}
+		}
+	}
+};
+
+using OpenSimplex2S = BasicOpenSimplex2S<double>;
+
+}
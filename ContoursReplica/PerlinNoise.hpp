@@ -26,10 +26,13 @@
 //----------------------------------------------------------------------------------------
 
 # pragma once
+# include <cstddef>
 # include <cstdint>
 # include <algorithm>
 # include <array>
+# include <cmath>
 # include <iterator>
+# include <limits>
 # include <numeric>
 # include <random>
 # include <type_traits>
@@ -81,8 +84,30 @@
 # endif
 
 
+// Inline namespace of this build of the header. Translation units compiled for other
+// instruction sets define it differently so their inline functions are never merged.
+# ifndef SIVPERLIN_ABI
+#	define SIVPERLIN_ABI abi_default
+# endif
+
+
+// SIMD lanes used by the row noise functions
+# if defined(__AVX512F__)
+#	define SIVPERLIN_SIMD_AVX512
+#	include <immintrin.h>
+# elif defined(__AVX__)
+#	define SIVPERLIN_SIMD_AVX
+#	include <immintrin.h>
+# elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (2 <= _M_IX86_FP))
+#	define SIVPERLIN_SIMD_SSE2
+#	include <emmintrin.h>
+# endif
+
+
 namespace siv
 {
+	inline namespace SIVPERLIN_ABI {
+
 	template <class Float>
 	class BasicPerlinNoise
 	{
@@ -118,6 +143,10 @@ namespace siv
 		SIVPERLIN_NODISCARD_CXX20
 		explicit BasicPerlinNoise(URBG&& urbg);
 
+		// From a serialized permutation of 256 entries
+		SIVPERLIN_NODISCARD_CXX20
+		explicit BasicPerlinNoise(const std::uint8_t* permutation) noexcept;
+
 		///////////////////////////////////////
 		//
 		//	Reseed
@@ -134,7 +163,7 @@ namespace siv
 		//
 
 		[[nodiscard]]
-		constexpr const state_type& serialize() const noexcept;
+		constexpr state_type serialize() const noexcept;
 
 		constexpr void deserialize(const state_type& state) noexcept;
 
@@ -236,15 +265,79 @@ namespace siv
 		[[nodiscard]]
 		value_type normalizedOctave3D_01(value_type x, value_type y, value_type z, std::int32_t octaves, value_type persistence = value_type(0.5)) const noexcept;
 
+		///////////////////////////////////////
+		//
+		//	Row noise (Writes noise2D(x0 + i * dx, y) for i in [0, count) to out)
+		//
+		//	Samples that share a lattice cell are evaluated in SIMD lanes.
+		//	The lane arithmetic mirrors noise2D() operation by operation, so the
+		//	results are identical to the scalar path unless the compiler contracts
+		//	one of them into FMA, in which case they differ by at most 8 ULP of 1.0.
+		//
+
+		void noise2D_row(value_type x0, value_type dx, value_type y, value_type* out, std::size_t count) const noexcept;
+
+		void noise2D_01_row(value_type x0, value_type dx, value_type y, value_type* out, std::size_t count) const noexcept;
+
+		///////////////////////////////////////
+		//
+		//	Periodic row noise (Writes noise2D((first + i) * dx, y) for i in [0, count) to out,
+		//	with the lattice repeating every periodX by periodY cells, 1 <= period <= 256)
+		//
+		//	The sample position only depends on the global index first + i, so a row
+		//	evaluated in separate pieces gives exactly the same values as in one call.
+		//	Periods of 256 reproduce noise2D().
+		//
+
+		void noise2D_periodic_row(std::int64_t first, value_type dx, value_type y, std::int32_t periodX, std::int32_t periodY, value_type* out, std::size_t count) const noexcept;
+
+		void noise2D_01_periodic_row(std::int64_t first, value_type dx, value_type y, std::int32_t periodX, std::int32_t periodY, value_type* out, std::size_t count) const noexcept;
+
+		///////////////////////////////////////
+		//
+		//	Noise with analytic gradient (The value is in the range [-1, 1],
+		//	gradX and gradY receive its partial derivatives along x and y)
+		//
+
+		value_type noise2D_grad(value_type x, value_type y, value_type& gradX, value_type& gradY) const noexcept;
+
+		void noise2D_grad_row(value_type x0, value_type dx, value_type y, value_type* out, value_type* gradX, value_type* gradY, std::size_t count) const noexcept;
+
+		void noise2D_grad_periodic_row(std::int64_t first, value_type dx, value_type y, std::int32_t periodX, std::int32_t periodY, value_type* out, value_type* gradX, value_type* gradY, std::size_t count) const noexcept;
+
 	private:
 
-		state_type m_permutation;
+		// a plain array, the row paths index it without calling std::array members, which every
+		// build of this header would share
+		std::uint8_t m_permutation[256];
+
+		template <bool WithGradient>
+		void rowNoise(value_type x0, std::int64_t first, value_type dx, value_type y, std::int32_t periodX, std::int32_t periodY, value_type* out, value_type* gradX, value_type* gradY, std::size_t count) const noexcept;
 	};
 
 	using PerlinNoise = BasicPerlinNoise<double>;
 
 	namespace perlin_detail
 	{
+		// floor of the C library; std::floor(float) is an inline function shared by every build of this header
+		[[nodiscard]]
+		inline float Floor(const float x) noexcept
+		{
+			return ::floorf(x);
+		}
+
+		[[nodiscard]]
+		inline double Floor(const double x) noexcept
+		{
+			return ::floor(x);
+		}
+
+		[[nodiscard]]
+		inline long double Floor(const long double x) noexcept
+		{
+			return ::floorl(x);
+		}
+
 		////////////////////////////////////////////////
 		//
 		//	These functions are provided for consistency.
@@ -403,6 +496,328 @@ namespace siv
 
 			return result;
 		}
+
+		////////////////////////////////////////////////
+		//
+		//	Lanes used by the row noise functions.
+		//
+		template <class Float>
+		struct ScalarLanes
+		{
+			using type = Float;
+
+			static constexpr std::size_t width = 1;
+
+			static type set1(const Float x) noexcept { return x; }
+
+			static type ramp(const std::int64_t i) noexcept { return static_cast<Float>(i); }
+
+			static type add(const type a, const type b) noexcept { return (a + b); }
+
+			static type sub(const type a, const type b) noexcept { return (a - b); }
+
+			static type mul(const type a, const type b) noexcept { return (a * b); }
+
+			static type max(const type a, const type b) noexcept { return ((a < b) ? b : a); }
+
+			static type load(const Float* p) noexcept { return *p; }
+
+			static void store(Float* p, const type a) noexcept { *p = a; }
+		};
+
+		template <class Float>
+		struct Lanes : ScalarLanes<Float> {};
+
+# if defined(SIVPERLIN_SIMD_AVX512)
+
+		template <>
+		struct Lanes<double>
+		{
+			using type = __m512d;
+
+			static constexpr std::size_t width = 8;
+
+			static type set1(const double x) noexcept { return _mm512_set1_pd(x); }
+
+			static type ramp(const std::int64_t i) noexcept
+			{
+				return _mm512_set_pd(static_cast<double>(i + 7), static_cast<double>(i + 6), static_cast<double>(i + 5), static_cast<double>(i + 4),
+					static_cast<double>(i + 3), static_cast<double>(i + 2), static_cast<double>(i + 1), static_cast<double>(i));
+			}
+
+			static type add(const type a, const type b) noexcept { return _mm512_add_pd(a, b); }
+
+			static type sub(const type a, const type b) noexcept { return _mm512_sub_pd(a, b); }
+
+			static type mul(const type a, const type b) noexcept { return _mm512_mul_pd(a, b); }
+
+			static type max(const type a, const type b) noexcept { return _mm512_max_pd(a, b); }
+
+			static type load(const double* p) noexcept { return _mm512_loadu_pd(p); }
+
+			static void store(double* p, const type a) noexcept { _mm512_storeu_pd(p, a); }
+		};
+
+		template <>
+		struct Lanes<float>
+		{
+			using type = __m512;
+
+			static constexpr std::size_t width = 16;
+
+			static type set1(const float x) noexcept { return _mm512_set1_ps(x); }
+
+			static type ramp(const std::int64_t i) noexcept
+			{
+				return _mm512_set_ps(static_cast<float>(i + 15), static_cast<float>(i + 14), static_cast<float>(i + 13), static_cast<float>(i + 12),
+					static_cast<float>(i + 11), static_cast<float>(i + 10), static_cast<float>(i + 9), static_cast<float>(i + 8),
+					static_cast<float>(i + 7), static_cast<float>(i + 6), static_cast<float>(i + 5), static_cast<float>(i + 4),
+					static_cast<float>(i + 3), static_cast<float>(i + 2), static_cast<float>(i + 1), static_cast<float>(i));
+			}
+
+			static type add(const type a, const type b) noexcept { return _mm512_add_ps(a, b); }
+
+			static type sub(const type a, const type b) noexcept { return _mm512_sub_ps(a, b); }
+
+			static type mul(const type a, const type b) noexcept { return _mm512_mul_ps(a, b); }
+
+			static type max(const type a, const type b) noexcept { return _mm512_max_ps(a, b); }
+
+			static type load(const float* p) noexcept { return _mm512_loadu_ps(p); }
+
+			static void store(float* p, const type a) noexcept { _mm512_storeu_ps(p, a); }
+		};
+
+# elif defined(SIVPERLIN_SIMD_AVX)
+
+		template <>
+		struct Lanes<double>
+		{
+			using type = __m256d;
+
+			static constexpr std::size_t width = 4;
+
+			static type set1(const double x) noexcept { return _mm256_set1_pd(x); }
+
+			static type ramp(const std::int64_t i) noexcept
+			{
+				return _mm256_setr_pd(static_cast<double>(i), static_cast<double>(i + 1), static_cast<double>(i + 2), static_cast<double>(i + 3));
+			}
+
+			static type add(const type a, const type b) noexcept { return _mm256_add_pd(a, b); }
+
+			static type sub(const type a, const type b) noexcept { return _mm256_sub_pd(a, b); }
+
+			static type mul(const type a, const type b) noexcept { return _mm256_mul_pd(a, b); }
+
+			static type max(const type a, const type b) noexcept { return _mm256_max_pd(a, b); }
+
+			static type load(const double* p) noexcept { return _mm256_loadu_pd(p); }
+
+			static void store(double* p, const type a) noexcept { _mm256_storeu_pd(p, a); }
+		};
+
+		template <>
+		struct Lanes<float>
+		{
+			using type = __m256;
+
+			static constexpr std::size_t width = 8;
+
+			static type set1(const float x) noexcept { return _mm256_set1_ps(x); }
+
+			static type ramp(const std::int64_t i) noexcept
+			{
+				return _mm256_setr_ps(static_cast<float>(i), static_cast<float>(i + 1), static_cast<float>(i + 2), static_cast<float>(i + 3),
+					static_cast<float>(i + 4), static_cast<float>(i + 5), static_cast<float>(i + 6), static_cast<float>(i + 7));
+			}
+
+			static type add(const type a, const type b) noexcept { return _mm256_add_ps(a, b); }
+
+			static type sub(const type a, const type b) noexcept { return _mm256_sub_ps(a, b); }
+
+			static type mul(const type a, const type b) noexcept { return _mm256_mul_ps(a, b); }
+
+			static type max(const type a, const type b) noexcept { return _mm256_max_ps(a, b); }
+
+			static type load(const float* p) noexcept { return _mm256_loadu_ps(p); }
+
+			static void store(float* p, const type a) noexcept { _mm256_storeu_ps(p, a); }
+		};
+
+# elif defined(SIVPERLIN_SIMD_SSE2)
+
+		template <>
+		struct Lanes<double>
+		{
+			using type = __m128d;
+
+			static constexpr std::size_t width = 2;
+
+			static type set1(const double x) noexcept { return _mm_set1_pd(x); }
+
+			static type ramp(const std::int64_t i) noexcept
+			{
+				return _mm_setr_pd(static_cast<double>(i), static_cast<double>(i + 1));
+			}
+
+			static type add(const type a, const type b) noexcept { return _mm_add_pd(a, b); }
+
+			static type sub(const type a, const type b) noexcept { return _mm_sub_pd(a, b); }
+
+			static type mul(const type a, const type b) noexcept { return _mm_mul_pd(a, b); }
+
+			static type max(const type a, const type b) noexcept { return _mm_max_pd(a, b); }
+
+			static type load(const double* p) noexcept { return _mm_loadu_pd(p); }
+
+			static void store(double* p, const type a) noexcept { _mm_storeu_pd(p, a); }
+		};
+
+		template <>
+		struct Lanes<float>
+		{
+			using type = __m128;
+
+			static constexpr std::size_t width = 4;
+
+			static type set1(const float x) noexcept { return _mm_set1_ps(x); }
+
+			static type ramp(const std::int64_t i) noexcept
+			{
+				return _mm_setr_ps(static_cast<float>(i), static_cast<float>(i + 1), static_cast<float>(i + 2), static_cast<float>(i + 3));
+			}
+
+			static type add(const type a, const type b) noexcept { return _mm_add_ps(a, b); }
+
+			static type sub(const type a, const type b) noexcept { return _mm_sub_ps(a, b); }
+
+			static type mul(const type a, const type b) noexcept { return _mm_mul_ps(a, b); }
+
+			static type max(const type a, const type b) noexcept { return _mm_max_ps(a, b); }
+
+			static type load(const float* p) noexcept { return _mm_loadu_ps(p); }
+
+			static void store(float* p, const type a) noexcept { _mm_storeu_ps(p, a); }
+		};
+
+# endif
+
+		[[nodiscard]]
+		inline constexpr std::int32_t Wrap(const std::int32_t i, const std::int32_t period) noexcept
+		{
+			return (((i % period) + period) % period);
+		}
+
+		////////////////////////////////////////////////
+		//
+		//	Within one lattice cell of a row, every corner gradient of noise3D()
+		//	reduces to a * fx + b where a is -1, 0 or 1 and b only depends on y and z.
+		//
+		template <class Float>
+		struct RowCell
+		{
+			Float a[8];
+			Float b[8];
+			Float c[8]; // derivative of each corner's gradient along y
+		};
+
+		template <class Float>
+		[[nodiscard]]
+		inline RowCell<Float> MakeRowCell(const std::uint8_t* hashes, const Float fy, const Float fz) noexcept
+		{
+			RowCell<Float> cell;
+
+			for (int k = 0; k < 8; ++k)
+			{
+				const Float y = ((k & 2) == 0) ? fy : fy - 1;
+				const Float z = ((k & 4) == 0) ? fz : fz - 1;
+				cell.a[k] = Grad(hashes[k], Float(1), Float(0), Float(0));
+				cell.b[k] = Grad(hashes[k], Float(0), y, z);
+				cell.c[k] = Grad(hashes[k], Float(0), Float(1), Float(0));
+			}
+
+			return cell;
+		}
+
+		template <class Float, class Vec, class L = Lanes<Float>>
+		[[nodiscard]]
+		inline Vec RowCellNoise(const RowCell<Float>& cell, const Vec fx, const Float v, const Float w) noexcept
+		{
+			const Vec fx1 = L::sub(fx, L::set1(Float(1)));
+
+			// Fade(fx)
+			const Vec u = L::mul(L::mul(L::mul(fx, fx), fx), L::add(L::mul(fx, L::sub(L::mul(fx, L::set1(Float(6))), L::set1(Float(15)))), L::set1(Float(10))));
+
+			Vec p[8];
+			for (int k = 0; k < 8; ++k)
+			{
+				p[k] = L::add(L::mul(L::set1(cell.a[k]), ((k & 1) == 0) ? fx : fx1), L::set1(cell.b[k]));
+			}
+
+			const Vec q0 = L::add(p[0], L::mul(L::sub(p[1], p[0]), u));
+			const Vec q1 = L::add(p[2], L::mul(L::sub(p[3], p[2]), u));
+			const Vec q2 = L::add(p[4], L::mul(L::sub(p[5], p[4]), u));
+			const Vec q3 = L::add(p[6], L::mul(L::sub(p[7], p[6]), u));
+
+			const Vec vv = L::set1(v);
+			const Vec r0 = L::add(q0, L::mul(L::sub(q1, q0), vv));
+			const Vec r1 = L::add(q2, L::mul(L::sub(q3, q2), vv));
+
+			return L::add(r0, L::mul(L::sub(r1, r0), L::set1(w)));
+		}
+
+		template <class Float>
+		[[nodiscard]]
+		inline constexpr Float FadeDerivative(const Float t) noexcept
+		{
+			return 30 * t * t * (t * (t - 2) + 1);
+		}
+
+		// Value and analytic partial derivatives of RowCellNoise()
+		template <class Float, class Vec, class L = Lanes<Float>>
+		inline void RowCellNoiseGrad(const RowCell<Float>& cell, const Vec fx, const Float v, const Float dv, const Float w, Vec& value, Vec& gradX, Vec& gradY) noexcept
+		{
+			const Vec fx1 = L::sub(fx, L::set1(Float(1)));
+
+			// Fade(fx) and its derivative
+			const Vec u = L::mul(L::mul(L::mul(fx, fx), fx), L::add(L::mul(fx, L::sub(L::mul(fx, L::set1(Float(6))), L::set1(Float(15)))), L::set1(Float(10))));
+			const Vec du = L::mul(L::mul(L::mul(L::set1(Float(30)), fx), fx), L::add(L::mul(fx, L::sub(fx, L::set1(Float(2)))), L::set1(Float(1))));
+
+			Vec p[8];
+			for (int k = 0; k < 8; ++k)
+			{
+				p[k] = L::add(L::mul(L::set1(cell.a[k]), ((k & 1) == 0) ? fx : fx1), L::set1(cell.b[k]));
+			}
+
+			Vec q[4], qx[4], qy[4];
+			for (int k = 0; k < 4; ++k)
+			{
+				const Vec p0 = p[2 * k];
+				const Vec p1 = p[2 * k + 1];
+				const Vec a0 = L::set1(cell.a[2 * k]);
+				const Vec a1 = L::set1(cell.a[2 * k + 1]);
+				const Vec c0 = L::set1(cell.c[2 * k]);
+				const Vec c1 = L::set1(cell.c[2 * k + 1]);
+				q[k] = L::add(p0, L::mul(L::sub(p1, p0), u));
+				qx[k] = L::add(L::add(a0, L::mul(L::sub(a1, a0), u)), L::mul(L::sub(p1, p0), du));
+				qy[k] = L::add(c0, L::mul(L::sub(c1, c0), u));
+			}
+
+			const Vec vv = L::set1(v);
+			const Vec dvv = L::set1(dv);
+			const Vec r0 = L::add(q[0], L::mul(L::sub(q[1], q[0]), vv));
+			const Vec r1 = L::add(q[2], L::mul(L::sub(q[3], q[2]), vv));
+			const Vec r0x = L::add(qx[0], L::mul(L::sub(qx[1], qx[0]), vv));
+			const Vec r1x = L::add(qx[2], L::mul(L::sub(qx[3], qx[2]), vv));
+			const Vec r0y = L::add(L::add(qy[0], L::mul(L::sub(qy[1], qy[0]), vv)), L::mul(L::sub(q[1], q[0]), dvv));
+			const Vec r1y = L::add(L::add(qy[2], L::mul(L::sub(qy[3], qy[2]), vv)), L::mul(L::sub(q[3], q[2]), dvv));
+
+			const Vec ww = L::set1(w);
+			value = L::add(r0, L::mul(L::sub(r1, r0), ww));
+			gradX = L::add(r0x, L::mul(L::sub(r1x, r0x), ww));
+			gradY = L::add(r0y, L::mul(L::sub(r1y, r0y), ww));
+		}
 	}
 
 	///////////////////////////////////////
@@ -436,6 +851,15 @@ namespace siv
 		reseed(std::forward<URBG>(urbg));
 	}
 
+	template <class Float>
+	inline BasicPerlinNoise<Float>::BasicPerlinNoise(const std::uint8_t* permutation) noexcept
+	{
+		for (std::size_t i = 0; i < 256; ++i)
+		{
+			m_permutation[i] = permutation[i];
+		}
+	}
+
 	///////////////////////////////////////
 
 	template <class Float>
@@ -448,23 +872,31 @@ namespace siv
 	SIVPERLIN_CONCEPT_URBG_
 	inline void BasicPerlinNoise<Float>::reseed(URBG&& urbg)
 	{
-		std::iota(m_permutation.begin(), m_permutation.end(), uint8_t{ 0 });
+		std::iota(std::begin(m_permutation), std::end(m_permutation), uint8_t{ 0 });
 
-		perlin_detail::Shuffle(m_permutation.begin(), m_permutation.end(), std::forward<URBG>(urbg));
+		perlin_detail::Shuffle(std::begin(m_permutation), std::end(m_permutation), std::forward<URBG>(urbg));
 	}
 
 	///////////////////////////////////////
 
 	template <class Float>
-	inline constexpr const typename BasicPerlinNoise<Float>::state_type& BasicPerlinNoise<Float>::serialize() const noexcept
+	inline constexpr typename BasicPerlinNoise<Float>::state_type BasicPerlinNoise<Float>::serialize() const noexcept
 	{
-		return m_permutation;
+		state_type state{};
+		for (std::size_t i = 0; i < state.size(); ++i)
+		{
+			state[i] = m_permutation[i];
+		}
+		return state;
 	}
 
 	template <class Float>
 	inline constexpr void BasicPerlinNoise<Float>::deserialize(const state_type& state) noexcept
 	{
-		m_permutation = state;
+		for (std::size_t i = 0; i < state.size(); ++i)
+		{
+			m_permutation[i] = state[i];
+		}
 	}
 
 	///////////////////////////////////////
@@ -488,9 +920,9 @@ namespace siv
 	template <class Float>
 	inline typename BasicPerlinNoise<Float>::value_type BasicPerlinNoise<Float>::noise3D(const value_type x, const value_type y, const value_type z) const noexcept
 	{
-		const value_type _x = std::floor(x);
-		const value_type _y = std::floor(y);
-		const value_type _z = std::floor(z);
+		const value_type _x = perlin_detail::Floor(x);
+		const value_type _y = perlin_detail::Floor(y);
+		const value_type _z = perlin_detail::Floor(z);
 
 		const std::int32_t ix = static_cast<std::int32_t>(_x) & 255;
 		const std::int32_t iy = static_cast<std::int32_t>(_y) & 255;
@@ -652,6 +1084,169 @@ namespace siv
 	{
 		return perlin_detail::Remap_01(normalizedOctave3D(x, y, z, octaves, persistence));
 	}
+
+	///////////////////////////////////////
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2D_row(const value_type x0, const value_type dx, const value_type y, value_type* const out, const std::size_t count) const noexcept
+	{
+		rowNoise<false>(x0, 0, dx, y, 256, 256, out, nullptr, nullptr, count);
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2D_01_row(const value_type x0, const value_type dx, const value_type y, value_type* const out, const std::size_t count) const noexcept
+	{
+		noise2D_row(x0, dx, y, out, count);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			out[i] = perlin_detail::Remap_01(out[i]);
+		}
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2D_periodic_row(const std::int64_t first, const value_type dx, const value_type y, const std::int32_t periodX, const std::int32_t periodY, value_type* const out, const std::size_t count) const noexcept
+	{
+		rowNoise<false>(value_type(0), first, dx, y, periodX, periodY, out, nullptr, nullptr, count);
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2D_01_periodic_row(const std::int64_t first, const value_type dx, const value_type y, const std::int32_t periodX, const std::int32_t periodY, value_type* const out, const std::size_t count) const noexcept
+	{
+		noise2D_periodic_row(first, dx, y, periodX, periodY, out, count);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			out[i] = perlin_detail::Remap_01(out[i]);
+		}
+	}
+
+	template <class Float>
+	inline typename BasicPerlinNoise<Float>::value_type BasicPerlinNoise<Float>::noise2D_grad(const value_type x, const value_type y, value_type& gradX, value_type& gradY) const noexcept
+	{
+		value_type value;
+		rowNoise<true>(x, 0, value_type(0), y, 256, 256, &value, &gradX, &gradY, 1);
+		return value;
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2D_grad_row(const value_type x0, const value_type dx, const value_type y, value_type* const out, value_type* const gradX, value_type* const gradY, const std::size_t count) const noexcept
+	{
+		rowNoise<true>(x0, 0, dx, y, 256, 256, out, gradX, gradY, count);
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2D_grad_periodic_row(const std::int64_t first, const value_type dx, const value_type y, const std::int32_t periodX, const std::int32_t periodY, value_type* const out, value_type* const gradX, value_type* const gradY, const std::size_t count) const noexcept
+	{
+		rowNoise<true>(value_type(0), first, dx, y, periodX, periodY, out, gradX, gradY, count);
+	}
+
+	template <class Float>
+	template <bool WithGradient>
+	inline void BasicPerlinNoise<Float>::rowNoise(const value_type x0, const std::int64_t first, const value_type dx, const value_type y, const std::int32_t periodX, const std::int32_t periodY, value_type* const out, value_type* const gradX, value_type* const gradY, const std::size_t count) const noexcept
+	{
+		using Lanes = perlin_detail::Lanes<value_type>;
+		using Vec = typename Lanes::type;
+
+		const auto position = [=](const std::size_t i) { return x0 + static_cast<value_type>(first + static_cast<std::int64_t>(i)) * dx; };
+
+		const value_type z = static_cast<value_type>(SIVPERLIN_DEFAULT_Z);
+
+		const value_type _y = perlin_detail::Floor(y);
+		const value_type _z = perlin_detail::Floor(z);
+
+		const std::int32_t iy0 = perlin_detail::Wrap(static_cast<std::int32_t>(_y), periodY);
+		const std::int32_t iy1 = perlin_detail::Wrap(static_cast<std::int32_t>(_y) + 1, periodY);
+		const std::int32_t iz = static_cast<std::int32_t>(_z) & 255;
+
+		const value_type fy = (y - _y);
+		const value_type fz = (z - _z);
+
+		const value_type v = perlin_detail::Fade(fy);
+		const value_type dv = perlin_detail::FadeDerivative(fy);
+		const value_type w = perlin_detail::Fade(fz);
+
+		std::size_t i = 0;
+
+		while (i < count)
+		{
+			const std::size_t cellFirst = i;
+			const value_type _x = perlin_detail::Floor(position(i));
+			const std::int32_t ix0 = perlin_detail::Wrap(static_cast<std::int32_t>(_x), periodX);
+			const std::int32_t ix1 = perlin_detail::Wrap(static_cast<std::int32_t>(_x) + 1, periodX);
+
+			// same hashing as noise3D() when both periods are 256
+			const std::uint8_t A0 = (m_permutation[ix0] + iy0) & 255;
+			const std::uint8_t A1 = (m_permutation[ix0] + iy1) & 255;
+			const std::uint8_t B0 = (m_permutation[ix1] + iy0) & 255;
+			const std::uint8_t B1 = (m_permutation[ix1] + iy1) & 255;
+
+			const std::uint8_t AA = (m_permutation[A0] + iz) & 255;
+			const std::uint8_t AB = (m_permutation[A1] + iz) & 255;
+
+			const std::uint8_t BA = (m_permutation[B0] + iz) & 255;
+			const std::uint8_t BB = (m_permutation[B1] + iz) & 255;
+
+			const std::uint8_t hashes[8] = {
+				m_permutation[AA], m_permutation[BA], m_permutation[AB], m_permutation[BB],
+				m_permutation[(AA + 1) & 255], m_permutation[(BA + 1) & 255], m_permutation[(AB + 1) & 255], m_permutation[(BB + 1) & 255] };
+
+			const perlin_detail::RowCell<value_type> cell = perlin_detail::MakeRowCell(hashes, fy, fz);
+
+			// full lanes inside the cell (x is monotonic, so checking the last lane is enough)
+			while (i + Lanes::width <= count
+				&& perlin_detail::Floor(position(i + Lanes::width - 1)) == _x)
+			{
+				const Vec x = Lanes::add(Lanes::set1(x0), Lanes::mul(Lanes::ramp(first + static_cast<std::int64_t>(i)), Lanes::set1(dx)));
+				const Vec fx = Lanes::sub(x, Lanes::set1(_x));
+				if constexpr (WithGradient)
+				{
+					Vec value, gx, gy;
+					perlin_detail::RowCellNoiseGrad<value_type, Vec>(cell, fx, v, dv, w, value, gx, gy);
+					Lanes::store(out + i, value);
+					Lanes::store(gradX + i, gx);
+					Lanes::store(gradY + i, gy);
+				}
+				else
+				{
+					Lanes::store(out + i, perlin_detail::RowCellNoise<value_type, Vec>(cell, fx, v, w));
+				}
+				i += Lanes::width;
+			}
+
+			// remaining samples inside the cell
+			while (i < count)
+			{
+				const value_type x = position(i);
+				if (perlin_detail::Floor(x) != _x)
+				{
+					break;
+				}
+				if constexpr (WithGradient)
+				{
+					perlin_detail::RowCellNoiseGrad<value_type, value_type, perlin_detail::ScalarLanes<value_type>>(cell, x - _x, v, dv, w, out[i], gradX[i], gradY[i]);
+				}
+				else
+				{
+					out[i] = perlin_detail::RowCellNoise<value_type, value_type, perlin_detail::ScalarLanes<value_type>>(cell, x - _x, v, w);
+				}
+				++i;
+			}
+
+			if (i == cellFirst)
+			{
+				// non-finite coordinate: the value comes from noise2D(), the gradient is undefined
+				out[i] = noise2D(position(i), y);
+				if constexpr (WithGradient)
+				{
+					gradX[i] = gradY[i] = static_cast<value_type>(NAN);
+				}
+				++i;
+			}
+		}
+	}
+
+	}
 }
 
 # undef SIVPERLIN_NODISCARD_CXX20
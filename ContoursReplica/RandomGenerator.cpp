@@ -2,7 +2,8 @@
 
 RandomGenerator& RandomGenerator::instance()
 {
-	static RandomGenerator generator;
+	// one engine per thread, so generations may run concurrently
+	static thread_local RandomGenerator generator;
 	return generator;
 }
 
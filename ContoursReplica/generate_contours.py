@@ -118,6 +118,7 @@ if __name__ == '__main__':
     parser = argparse.ArgumentParser(description='Генерация карты рельефа с изолиниями.')
     parser.add_argument('--output', type=str, help='Имя файла для сохранения изображения')
     parser.add_argument('--output_mask', type=str, help='Имя файла для сохранения маски изображения')
+    parser.add_argument('--field', type=str, help='Файл с готовым полем высот (float32, h x w)')
     parser.add_argument('--w', type=int, help='Ширина сетки')
     parser.add_argument('--h', type=int, help='Высота сетки')
     parser.add_argument('--dpi', type=int, help='Разрешение рендера')
@@ -138,15 +139,18 @@ if __name__ == '__main__':
     # Параметры карты
     W, H = args.w, args.h
     dpi = args.dpi
-    field = generate_height_field(
-        width=W,
-        height=H,
-        scale=80.0,
-        octaves=5,
-        persistence=0.6,
-        lacunarity=2.0,
-        seed=seed
-    )
+    if args.field:
+        field = np.fromfile(args.field, dtype=np.float32).reshape(H, W)
+    else:
+        field = generate_height_field(
+            width=W,
+            height=H,
+            scale=80.0,
+            octaves=5,
+            persistence=0.6,
+            lacunarity=2.0,
+            seed=seed
+        )
 
     font_size = args.text_size
     density = args.contours_density
@@ -0,0 +1,459 @@
+// Checks of the image and contour operations, no GUI involved; exits with the number of failed checks
+#include "ContoursOperations.h"
+#include <opencv2/ximgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { ++failures; std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); } } while (0)
+
+// Inverted isolines of a random tile (255 on the lines), the input the legacy pipeline thins
+static cv::Mat isolineMask(int width, int height, unsigned int seed)
+{
+	GenerationParams params{};
+	params.width = width;
+	params.height = height;
+	params.Xmul = 0.03;
+	params.Ymul = 0.03;
+	params.mul = 20;
+	TileParams tile;
+	tile.seed = seed;
+
+	return cv::Scalar(255) - ContoursOperations::generateIsolines<float>(params, tile);
+}
+
+// Thinned isolines of a random tile, the input the legacy pipeline traces
+static cv::Mat thinnedIsolines(int width, int height, unsigned int seed)
+{
+	cv::Mat thinned;
+	ContoursOperations::thinning(isolineMask(width, height, seed), thinned);
+	return thinned;
+}
+
+// Random 0/255 pixels: many junctions and components touching the band borders in the middle
+static cv::Mat randomPixels(int width, int height, int percent, std::mt19937& rng)
+{
+	cv::Mat img(height, width, CV_8UC1);
+	for (int j = 0; j < height; ++j)
+	{
+		uchar* row = img.ptr<uchar>(j);
+		for (int i = 0; i < width; ++i)
+		{
+			row[i] = static_cast<int>(rng() % 100) < percent ? 255 : 0;
+		}
+	}
+	return img;
+}
+
+// Random bytes, the thinning input threshold is 128
+static cv::Mat randomBytes(int width, int height, std::mt19937& rng)
+{
+	cv::Mat img(height, width, CV_8UC1);
+	for (int j = 0; j < height; ++j)
+	{
+		uchar* row = img.ptr<uchar>(j);
+		for (int i = 0; i < width; ++i)
+		{
+			row[i] = static_cast<uchar>(rng());
+		}
+	}
+	return img;
+}
+
+static bool sameContours(const ContourSet& a, const ContourSet& b)
+{
+	return a.points == b.points && a.offsets == b.offsets && a.isClosed == b.isClosed && a.boundingRect == b.boundingRect;
+}
+
+static bool sameLabels(const cv::Mat& a, const cv::Mat& b)
+{
+	return a.size() == b.size() && cv::countNonZero(a != b) == 0;
+}
+
+// part equals the pixels of map under rect, byte for byte
+static bool sameAsCrop(const cv::Mat& part, const cv::Mat& map, const cv::Rect& rect)
+{
+	if (part.type() != map.type() || part.size() != rect.size())
+	{
+		return false;
+	}
+	for (int j = 0; j < rect.height; ++j)
+	{
+		if (std::memcmp(part.ptr(j), map.ptr(rect.y + j) + rect.x * map.elemSize(), rect.width * map.elemSize()) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// A tile generated on its own matches the same pixels of the whole map; periods out of 1..256 are clamped
+static void testTileParams()
+{
+	GenerationParams params{};
+	params.width = 128;
+	params.height = 128;
+	params.Xmul = 0.03;
+	params.Ymul = 0.03;
+	params.mul = 20;
+	TileParams tile;
+	tile.seed = 4;
+
+	const cv::Mat map = ContoursOperations::generateNoiseField<float>(params, tile);
+	params.width = 64;
+	params.height = 64;
+	tile.x = 64;
+	tile.y = 32;
+	const cv::Mat part = ContoursOperations::generateNoiseField<float>(params, tile);
+	CHECK(cv::countNonZero(part != map(cv::Rect(64, 32, 64, 64))) == 0);
+
+	tile.periodX = 0;
+	tile.periodY = -3;
+	const cv::Mat wrapped = ContoursOperations::generateNoiseField<float>(params, tile);
+	CHECK(wrapped.size() == part.size());
+}
+
+// Isolines of a tile computed on its own equal the same pixels of the whole map, tile edges included:
+// the Sobel path samples a 1 pixel apron from the neighbouring tiles, the analytic path needs none
+static void testIsolineTiles()
+{
+	GenerationParams params{};
+	params.Xmul = 0.021;
+	params.Ymul = 0.017;
+	params.mul = 20;
+	TileParams mapTile;
+	mapTile.seed = 8;
+	mapTile.x = -40;
+	mapTile.y = 25;
+	mapTile.periodX = 100;
+
+	for (NoiseBackend noise : { NoiseBackend::perlin, NoiseBackend::openSimplex2S })
+	{
+		for (bool analytic : { false, true })
+		{
+			params.noise = noise;
+			params.analyticGradient = analytic;
+			params.width = 200; // rows
+			params.height = 260; // cols
+			cv::Mat mapGradient;
+			const cv::Mat map = ContoursOperations::generateIsolines<float>(params, mapTile, &mapGradient);
+
+			// map corners, edges and the interior, odd sizes
+			const cv::Rect rects[] = { { 0, 0, 64, 64 }, { 196, 136, 64, 64 }, { 100, 0, 77, 31 }, { 0, 150, 13, 50 }, { 37, 51, 129, 97 }, { 259, 199, 1, 1 } };
+			for (const cv::Rect& rect : rects)
+			{
+				TileParams tile = mapTile;
+				tile.x += rect.x;
+				tile.y += rect.y;
+				params.width = rect.height;
+				params.height = rect.width;
+				cv::Mat gradient;
+				const cv::Mat part = ContoursOperations::generateIsolines<float>(params, tile, &gradient);
+				CHECK(sameAsCrop(part, map, rect));
+				if (analytic)
+				{
+					CHECK(sameAsCrop(gradient, mapGradient, rect));
+				}
+			}
+		}
+	}
+}
+
+// The fused isoline kernel equals the OpenCV chain it replaces (Sobel x and y, convertScaleAbs,
+// addWeighted, threshold, inversion) on the fractional noise field; only the interior is compared,
+// the chain reflects at the image border where the kernel reads the apron
+template <class Float>
+static void checkIsolineChain(NoiseBackend noise, int rows, int cols, unsigned int seed)
+{
+	GenerationParams params{};
+	params.width = rows;
+	params.height = cols;
+	params.Xmul = 0.013;
+	params.Ymul = 0.011;
+	params.mul = 23;
+	params.noise = noise;
+	TileParams tile;
+	tile.seed = seed;
+	tile.x = -37;
+	tile.y = 55;
+
+	cv::Mat field = ContoursOperations::generateNoiseField<Float>(params, tile);
+	for (int j = 0; j < field.rows; ++j)
+	{
+		Float* row = field.ptr<Float>(j);
+		for (int i = 0; i < field.cols; ++i)
+		{
+			row[i] -= std::floor(row[i]);
+		}
+	}
+
+	cv::Mat gradX, gradY, absGradX, absGradY, grad;
+	cv::Sobel(field, gradX, field.depth(), 1, 0);
+	cv::Sobel(field, gradY, field.depth(), 0, 1);
+	cv::convertScaleAbs(gradX, absGradX);
+	cv::convertScaleAbs(gradY, absGradY);
+	cv::addWeighted(absGradX, 0.5, absGradY, 0.5, 0, grad);
+	cv::threshold(grad, grad, 1, 255, cv::THRESH_BINARY);
+	const cv::Mat expected = cv::Scalar(255) - grad;
+
+	const cv::Mat isolines = ContoursOperations::generateIsolines<Float>(params, tile);
+	const cv::Rect interior(1, 1, cols - 2, rows - 2);
+	CHECK(sameAsCrop(isolines(interior), expected, interior));
+}
+
+static void testIsolineChain()
+{
+	for (NoiseBackend noise : { NoiseBackend::perlin, NoiseBackend::openSimplex2S })
+	{
+		checkIsolineChain<float>(noise, 97, 130, 3);
+		checkIsolineChain<float>(noise, 200, 67, 4);
+		checkIsolineChain<double>(noise, 97, 130, 3);
+		checkIsolineChain<double>(noise, 200, 67, 4);
+	}
+}
+
+// The coarse noise field stays within the reported bound of the exact one and within the tolerance;
+// a tile sampled on its own uses the same lattice as the whole map
+static void testNoiseSampling()
+{
+	GenerationParams params{};
+	params.width = 240;
+	params.height = 310;
+	TileParams tile;
+	tile.seed = 12;
+	tile.x = -71;
+	tile.y = 33;
+
+	const double muls[][2] = { { 0.005, 0.005 }, { 0.011, 0.008 }, { 0.02, 0.013 } };
+	for (NoiseBackend noise : { NoiseBackend::perlin, NoiseBackend::openSimplex2S })
+	{
+		for (const auto& mul : muls)
+		{
+			for (double tolerance : { 0.05, 0.2, 1.0 })
+			{
+				params.noise = noise;
+				params.Xmul = mul[0];
+				params.Ymul = mul[1];
+				params.mul = 20;
+				params.noiseTolerance = 0;
+				const cv::Mat exact = ContoursOperations::generateNoiseField<double>(params, tile);
+
+				params.noiseTolerance = tolerance;
+				const NoiseSampling sampling = ContoursOperations::noiseSampling(params);
+				CHECK(sampling.errorBound <= tolerance);
+				const cv::Mat coarse = ContoursOperations::generateNoiseField<double>(params, tile);
+				CHECK(cv::norm(coarse, exact, cv::NORM_INF) <= sampling.errorBound + 1e-9);
+			}
+		}
+
+		params.Xmul = 0.005;
+		params.Ymul = 0.005;
+		params.noiseTolerance = 0.5;
+		CHECK(ContoursOperations::noiseSampling(params).step > 4);
+		const cv::Mat map = ContoursOperations::generateNoiseField<double>(params, tile);
+		const cv::Rect rect(45, 101, 77, 64);
+		TileParams part = tile;
+		part.x += rect.x;
+		part.y += rect.y;
+		GenerationParams partParams = params;
+		partParams.width = rect.height;
+		partParams.height = rect.width;
+		CHECK(sameAsCrop(ContoursOperations::generateNoiseField<double>(partParams, part), map, rect));
+	}
+}
+
+// The bit-parallel thinning equals cv::ximgproc::thinning(THINNING_GUOHALL); widths are not multiples
+// of the 64 pixel words and heights not multiples of the 32 row bands
+static void testThinning()
+{
+	std::mt19937 rng(11);
+	const cv::Size sizes[] = { { 131, 77 }, { 200, 45 }, { 65, 33 }, { 63, 31 }, { 257, 97 }, { 3, 3 }, { 1, 40 }, { 70, 1 } };
+	for (const cv::Size& size : sizes)
+	{
+		std::vector<cv::Mat> images;
+		images.push_back(randomPixels(size.width, size.height, 50, rng));
+		images.push_back(randomPixels(size.width, size.height, 85, rng));
+		images.push_back(randomBytes(size.width, size.height, rng));
+		images.push_back(isolineMask(size.height, size.width, rng()));
+		for (const cv::Mat& img : images)
+		{
+			cv::Mat expected;
+			cv::ximgproc::thinning(img, expected, cv::ximgproc::THINNING_GUOHALL);
+			cv::Mat thinned;
+			ContoursOperations::thinning(img, thinned);
+			CHECK(sameAsCrop(thinned, expected, cv::Rect(cv::Point(0, 0), expected.size())));
+		}
+	}
+}
+
+static void testFindContoursParallel()
+{
+	std::mt19937 rng(13);
+	std::vector<cv::Mat> images;
+	for (int i = 0; i < 4; ++i)
+	{
+		images.push_back(thinnedIsolines(64 + static_cast<int>(rng() % 200), 64 + static_cast<int>(rng() % 200), rng()));
+		images.push_back(randomPixels(32 + static_cast<int>(rng() % 100), 32 + static_cast<int>(rng() % 100), 10 + 10 * i, rng));
+	}
+
+	for (const cv::Mat& img : images)
+	{
+		ContourSet expected;
+		cv::Mat expectedLabels;
+		ContoursOperations::findContours(img, expected, &expectedLabels);
+
+		for (int tileRows : { 1, 2, 3, 7, 16, 64, 1000 })
+		{
+			ContourSet contours;
+			cv::Mat labels;
+			ContoursOperations::findContoursParallel(img, contours, &labels, tileRows);
+			CHECK(sameContours(contours, expected));
+			CHECK(sameLabels(labels, expectedLabels));
+
+			ContourSet unlabelled;
+			ContoursOperations::findContoursParallel(img, unlabelled, nullptr, tileRows);
+			CHECK(sameContours(unlabelled, expected));
+		}
+	}
+}
+
+// Points decoded from the chain codes equal the encoded points, for traced, marching squares and
+// arbitrary point lists (jumps and repeated points start new runs)
+static void testChainCodes()
+{
+	std::mt19937 rng(5);
+	std::vector<ContourSet> sets(3);
+	ContoursOperations::findContours(thinnedIsolines(301, 157, 21), sets[0]);
+
+	GenerationParams params{};
+	params.width = 200;
+	params.height = 120;
+	params.Xmul = 0.03;
+	params.Ymul = 0.03;
+	params.mul = 20;
+	ContoursOperations::marchingSquares(ContoursOperations::generateNoiseField<float>(params, TileParams()), sets[1]);
+
+	// empty, single point, exactly one word of steps, a jump, a repeated point, long random walks
+	ContourSet& made = sets[2];
+	made.addContour(false);
+	made.points.emplace_back(3, 4);
+	made.addContour(false);
+	for (int i = 0; i <= ChainCode::stepsPerWord; ++i)
+	{
+		made.points.emplace_back(i, 0);
+	}
+	made.addContour(false);
+	made.points.insert(made.points.end(), { { 0, 0 }, { 1, 1 }, { 5, 1 }, { 5, 2 }, { 5, 2 }, { 4, 3 } });
+	made.addContour(true);
+	for (int c = 0; c < 4; ++c)
+	{
+		cv::Point pt(100, 100);
+		for (int i = 0; i < 1000; ++i)
+		{
+			made.points.push_back(pt);
+			const int d = static_cast<int>(rng() % 10);
+			pt += d < 8 ? cv::Point(ChainCode::stepX[d], ChainCode::stepY[d]) : cv::Point(static_cast<int>(rng() % 7) - 3, 2 * (d - 8));
+		}
+		made.addContour(c % 2 == 0);
+	}
+
+	for (const ContourSet& contours : sets)
+	{
+		CHECK(!contours.empty());
+		ChainCodeSet codes;
+		ContoursOperations::encodeChainCodes(contours, codes);
+		CHECK(codes.size() == contours.size());
+
+		for (size_t i = 0; i < contours.size(); ++i)
+		{
+			const Span<cv::Point> points = contours.contourPoints(i);
+			std::vector<cv::Point> decoded(codes[i].begin(), codes[i].end());
+			CHECK(decoded.size() == points.size() && std::equal(decoded.begin(), decoded.end(), points.begin()));
+			CHECK(codes.value[i] == contours.value[i] && codes.isClosed[i] == contours.isClosed[i]);
+
+			// the steps read one at a time rebuild the same points
+			std::vector<cv::Point> stepped;
+			for (size_t r = codes.runOffsets[i]; r < codes.runOffsets[i + 1]; ++r)
+			{
+				cv::Point pt = codes.start[r];
+				stepped.push_back(pt);
+				for (size_t k = 0; k + 1 < codes.runCount[r]; ++k)
+				{
+					const int d = static_cast<int>(codes.step(r, k));
+					pt += cv::Point(ChainCode::stepX[d], ChainCode::stepY[d]);
+					stepped.push_back(pt);
+				}
+			}
+			CHECK(stepped == decoded);
+		}
+	}
+
+	// traced contours are 8-connected: one run each
+	ChainCodeSet codes;
+	ContoursOperations::encodeChainCodes(sets[0], codes);
+	CHECK(codes.start.size() == sets[0].size());
+}
+
+// The R-tree returns exactly the contours whose bounding box intersects the query rect
+static void testContourIndex()
+{
+	std::mt19937 rng(17);
+	std::vector<ContourSet> sets(4);
+	ContoursOperations::findContours(thinnedIsolines(512, 384, 3), sets[0]);
+	ContoursOperations::findContours(randomPixels(300, 200, 30, rng), sets[1]);
+	sets[2].points.emplace_back(7, 9);
+	sets[2].addContour(false);
+
+	for (const ContourSet& contours : sets)
+	{
+		const ContourIndex index(contours);
+		for (int q = 0; q < 2000; ++q)
+		{
+			// rects of every size, partly or completely outside the map, and empty ones
+			const cv::Rect rect(static_cast<int>(rng() % 600) - 50, static_cast<int>(rng() % 450) - 50,
+				static_cast<int>(rng() % (q % 4 == 0 ? 400 : 40)), static_cast<int>(rng() % (q % 4 == 0 ? 300 : 40)));
+
+			std::vector<int> expected;
+			for (size_t i = 0; i < contours.size(); ++i)
+			{
+				if (!(contours.boundingRect[i] & rect).empty())
+				{
+					expected.push_back(static_cast<int>(i));
+				}
+			}
+
+			std::vector<int> found;
+			index.query(rect, found);
+			std::sort(found.begin(), found.end());
+			CHECK(found == expected);
+		}
+	}
+}
+
+int main()
+{
+	const std::pair<const char*, std::function<void()>> tests[] = {
+		{ "tileParams", testTileParams },
+		{ "isolineTiles", testIsolineTiles },
+		{ "isolineChain", testIsolineChain },
+		{ "noiseSampling", testNoiseSampling },
+		{ "thinning", testThinning },
+		{ "findContoursParallel", testFindContoursParallel },
+		{ "chainCodes", testChainCodes },
+		{ "contourIndex", testContourIndex },
+	};
+
+	for (const auto& test : tests)
+	{
+		const int before = failures;
+		test.second();
+		std::printf("%-32s %s\n", test.first, failures == before ? "ok" : "FAILED");
+	}
+	return failures;
+}